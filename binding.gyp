@@ -12,6 +12,21 @@
                 "bsatk/src/bsafolder.cpp",
                 "bsatk/src/bsatypes.cpp",
                 "bsatk/src/filehash.cpp",
+                "bsabudget.cpp",
+                "bsadeploy.cpp",
+                "bsahandles.cpp",
+                "bsaindex.cpp",
+                "bsamanifest.cpp",
+                "bsamemory.cpp",
+                "bsametrics.cpp",
+                "bsapath.cpp",
+                "bsareader.cpp",
+                "bsascheduler.cpp",
+                "bsasearch.cpp",
+                "bsashared.cpp",
+                "bsasource.cpp",
+                "bsatexture.cpp",
+                "bsawriter.cpp",
                 "index.cpp"
             ],
             "include_dirs": [
@@ -53,6 +68,77 @@
                         }
                     }
                 ],
+                [
+                    'OS=="linux"',
+                    {
+                        "libraries": [
+                            "-lrt"
+                        ]
+                    }
+                ],
+                [
+                    'OS=="mac"',
+                    {
+                        "xcode_settings": {
+                            "GCC_ENABLE_CPP_EXCEPTIONS": "YES"
+                        }
+                    }
+                ]
+            ]
+        },
+        {
+            "target_name": "bsatool",
+            "type": "executable",
+            "sources": [
+                "bsabudget.cpp",
+                "bsahandles.cpp",
+                "bsaindex.cpp",
+                "bsamanifest.cpp",
+                "bsamemory.cpp",
+                "bsapath.cpp",
+                "bsareader.cpp",
+                "bsasearch.cpp",
+                "bsasource.cpp",
+                "bsatexture.cpp",
+                "bsatool.cpp",
+                "bsawriter.cpp"
+            ],
+            "include_dirs": [
+                "./zlib/include"
+            ],
+            "cflags!": ["-fno-exceptions"],
+            "cflags_cc!": ["-fno-exceptions"],
+            "conditions": [
+                [
+                    'OS=="win"',
+                    {
+                        "defines!": [
+                            "_HAS_EXCEPTIONS=0"
+                        ],
+                        "libraries": [
+                            "-l../zlib/win32/zlibstatic.lib"
+                        ],
+                        "msvs_settings": {
+                            "VCCLCompilerTool": {
+                                "ExceptionHandling": 1
+                            }
+                        },
+                        "msbuild_settings": {
+                          "ClCompile": {
+                            "AdditionalOptions": ['-std:c++17']
+                          }
+                        }
+                    }
+                ],
+                [
+                    'OS!="win"',
+                    {
+                        "libraries": [
+                            "-lz",
+                            "-lpthread"
+                        ]
+                    }
+                ],
                 [
                     'OS=="mac"',
                     {
@@ -0,0 +1,90 @@
+#include "bsabudget.h"
+#include "bsamemory.h"
+#include <algorithm>
+
+namespace {
+
+const uint64_t DEFAULT_EXTRACTION_BUDGET = 256 * 1024 * 1024;
+
+}
+
+MemoryBudget::Lease::Lease(Lease &&other)
+  : m_Budget(other.m_Budget), m_Size(other.m_Size)
+{
+  other.m_Budget = nullptr;
+  other.m_Size = 0;
+}
+
+MemoryBudget::Lease &MemoryBudget::Lease::operator=(Lease &&other) {
+  if (this != &other) {
+    if (m_Budget != nullptr) {
+      m_Budget->release(m_Size);
+    }
+    m_Budget = other.m_Budget;
+    m_Size = other.m_Size;
+    other.m_Budget = nullptr;
+    other.m_Size = 0;
+  }
+  return *this;
+}
+
+MemoryBudget::Lease::~Lease() {
+  if (m_Budget != nullptr) {
+    m_Budget->release(m_Size);
+  }
+}
+
+MemoryBudget &MemoryBudget::extraction() {
+  static MemoryBudget s_Budget(DEFAULT_EXTRACTION_BUDGET);
+  return s_Budget;
+}
+
+MemoryBudget::MemoryBudget(uint64_t limit)
+  : m_Limit(limit)
+{}
+
+void MemoryBudget::setLimit(uint64_t limit) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Limit = limit;
+  m_Changed.notify_all();
+}
+
+uint64_t MemoryBudget::limit() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Limit;
+}
+
+uint64_t MemoryBudget::inUse() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_InUse;
+}
+
+MemoryBudget::Lease MemoryBudget::acquire(uint64_t size) {
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  uint64_t ticket = m_NextTicket++;
+  uint64_t granted = 0;
+  m_Changed.wait(lock, [this, ticket, size, &granted]() {
+    // the limit may change while waiting so the clamp is reevaluated
+    granted = std::min(size, m_Limit);
+    return (ticket == m_Serving) && (m_InUse + granted <= m_Limit);
+  });
+  m_InUse += granted;
+  ++m_Serving;
+  MemoryAccount::process().charge(MemoryCategory::BUFFERS, granted);
+  m_Changed.notify_all();
+  return Lease(this, granted);
+}
+
+MemoryBudget::Lease MemoryBudget::charge(uint64_t size) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_InUse += size;
+  MemoryAccount::process().charge(MemoryCategory::BUFFERS, size);
+  return Lease(this, size);
+}
+
+void MemoryBudget::release(uint64_t size) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_InUse -= size;
+  MemoryAccount::process().credit(MemoryCategory::BUFFERS, size);
+  m_Changed.notify_all();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * limit on the memory held by operations in flight. Operations lease the memory
+ * they are about to use and block until enough of the budget is free. Leases are
+ * granted in the order they were requested so large requests don't starve.
+ */
+class MemoryBudget {
+public:
+  /// returns its share of the budget on destruction
+  class Lease {
+  public:
+    Lease() = default;
+    Lease(Lease &&other);
+    Lease &operator=(Lease &&other);
+    ~Lease();
+
+    uint64_t size() const { return m_Size; }
+
+  private:
+    friend class MemoryBudget;
+    Lease(MemoryBudget *budget, uint64_t size) : m_Budget(budget), m_Size(size) {}
+
+  private:
+    MemoryBudget *m_Budget{ nullptr };
+    uint64_t m_Size{ 0 };
+  };
+
+public:
+  /// budget for the buffers of all extractions in the process
+  static MemoryBudget &extraction();
+
+  explicit MemoryBudget(uint64_t limit);
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget &operator=(const MemoryBudget&) = delete;
+
+  void setLimit(uint64_t limit);
+  uint64_t limit() const;
+  uint64_t inUse() const;
+
+  /**
+   * block until size bytes of the budget are free. Requests larger than the limit
+   * are clamped to it, they proceed once nothing else is in flight
+   */
+  Lease acquire(uint64_t size);
+
+  /**
+   * book memory that is already held without waiting, e.g. data decoded by work
+   * that holds a lease of its own. This may take the budget past its limit, later
+   * requests wait until enough of it is returned
+   */
+  Lease charge(uint64_t size);
+
+private:
+  void release(uint64_t size);
+
+private:
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_Changed;
+  uint64_t m_Limit;
+  uint64_t m_InUse{ 0 };
+  uint64_t m_NextTicket{ 0 };
+  uint64_t m_Serving{ 0 };
+};
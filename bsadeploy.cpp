@@ -0,0 +1,144 @@
+#include "bsadeploy.h"
+#include <stdexcept>
+
+Deployment::Deployment(std::vector<DeployJob> jobs, IOSchedule schedule)
+  : m_Jobs(std::move(jobs))
+  , m_Schedule(schedule)
+  , m_States(m_Jobs.size())
+{
+}
+
+void Deployment::plan(size_t job) {
+  const DeployJob &item = m_Jobs[job];
+  try {
+    std::unique_ptr<ArchiveReader::Extraction> extraction(
+      new ArchiveReader::Extraction(*item.reader, item.outputDirectory, m_Schedule));
+    if (!item.filter.empty()) {
+      SearchPage matches = item.reader->index()->pathIndex().search(item.filterMode, item.filter, 0, UINT32_MAX);
+      extraction->restrict(matches.files);
+    }
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    State &state = m_States[job];
+    state.exhausted = extraction->numFiles() == 0;
+    state.extraction = std::move(extraction);
+  }
+  catch (const std::exception &e) {
+    fail(job, e.what());
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ++m_Planned;
+  }
+  m_Changed.notify_all();
+}
+
+size_t Deployment::pickJob() {
+  size_t result = SIZE_MAX;
+  uint64_t bestShare = 0;
+  for (size_t i = 0; i < m_States.size(); ++i) {
+    State &state = m_States[i];
+    if (!state.extraction || state.exhausted) {
+      continue;
+    }
+    // an archive with everything claimed still gets picked once, its step
+    // returns false right away and marks it exhausted
+    uint64_t share = state.extraction->remainingSize() / (state.active + 1);
+    if ((result == SIZE_MAX) || (share > bestShare)) {
+      result = i;
+      bestShare = share;
+    }
+  }
+  return result;
+}
+
+void Deployment::fail(size_t job, const std::string &error) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  State &state = m_States[job];
+  if (state.error.empty()) {
+    state.error = error;
+  }
+  state.exhausted = true;
+}
+
+bool Deployment::step() {
+  if (m_Canceled) {
+    return false;
+  }
+
+  size_t job = m_NextPlan++;
+  if (job < m_Jobs.size()) {
+    plan(job);
+    return true;
+  }
+
+  ArchiveReader::Extraction *extraction;
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    // archives still being planned may need more threads than the ones planning them
+    m_Changed.wait(lock, [this, &job]() {
+      job = pickJob();
+      return (job != SIZE_MAX) || (m_Planned == m_Jobs.size()) || m_Canceled;
+    });
+    if ((job == SIZE_MAX) || m_Canceled) {
+      return false;
+    }
+    ++m_States[job].active;
+    extraction = m_States[job].extraction.get();
+  }
+
+  bool more = false;
+  try {
+    more = extraction->step([this](int, std::string) { return !m_Canceled; });
+  }
+  catch (const std::exception &e) {
+    fail(job, e.what());
+  }
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  State &state = m_States[job];
+  --state.active;
+  if (!more) {
+    state.exhausted = true;
+  }
+  return true;
+}
+
+void Deployment::cancel() {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Canceled = true;
+  }
+  m_Changed.notify_all();
+}
+
+DeployProgress Deployment::progress() const {
+  DeployProgress result;
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (const State &state : m_States) {
+    if (state.extraction) {
+      result.files += state.extraction->extracted();
+      result.totalFiles += state.extraction->numFiles();
+      result.size += state.extraction->extractedSize();
+      result.totalSize += state.extraction->totalSize();
+    }
+  }
+  return result;
+}
+
+std::vector<DeployResult> Deployment::results() const {
+  std::vector<DeployResult> result(m_Jobs.size());
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (size_t i = 0; i < m_States.size(); ++i) {
+    const State &state = m_States[i];
+    result[i].error = state.error;
+    if (state.extraction) {
+      result[i].files = state.extraction->extracted();
+      result[i].size = state.extraction->extractedSize();
+    }
+    bool complete = state.extraction && (state.extraction->extracted() == state.extraction->numFiles());
+    if (result[i].error.empty() && !complete) {
+      result[i].error = "canceled";
+    }
+  }
+  return result;
+}
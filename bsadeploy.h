@@ -0,0 +1,100 @@
+#pragma once
+
+#include "bsareader.h"
+#include "bsasearch.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// one archive of a deployment
+struct DeployJob {
+  std::shared_ptr<ArchiveReader> reader;
+  std::string outputDirectory;
+  /// only files matching the filter get extracted, all of them if it's empty
+  std::string filter;
+  SearchMode filterMode{ SearchMode::PREFIX };
+};
+
+/// outcome of one archive of a deployment
+struct DeployResult {
+  uint32_t files{ 0 };
+  /// size of the extracted records, as stored in the archive
+  uint64_t size{ 0 };
+  /// empty if all files were extracted
+  std::string error;
+};
+
+struct DeployProgress {
+  uint32_t files{ 0 };
+  uint32_t totalFiles{ 0 };
+  uint64_t size{ 0 };
+  uint64_t totalSize{ 0 };
+};
+
+/**
+ * extraction of a list of archives as one body of work. Steps can run on any
+ * number of threads. The first steps plan the archives, one each, so the filters
+ * and file orders of all archives are worked out in parallel. After that every
+ * step extracts one batch of the archive with the most data left per thread
+ * already working on it, so large archives get more threads without starving
+ * the small ones and threads move on to other archives as soon as one runs dry.
+ * Within an archive files are extracted in the order of its IOSchedule.
+ * A failing archive is reported in its result, the others carry on
+ */
+class Deployment {
+public:
+  Deployment(std::vector<DeployJob> jobs, IOSchedule schedule);
+  Deployment(const Deployment&) = delete;
+  Deployment &operator=(const Deployment&) = delete;
+
+  size_t numJobs() const { return m_Jobs.size(); }
+
+  /**
+   * plan or extract the next piece of work. Thread-safe
+   * @return false once there is nothing left to start on
+   */
+  bool step();
+
+  /// stop starting new work, steps already running finish their batch. Thread-safe
+  void cancel();
+  bool canceled() const { return m_Canceled; }
+
+  /// true once every archive has been planned, totals of the progress are final from then on
+  bool planned() const { return m_Planned.load() == m_Jobs.size(); }
+
+  /// progress over all archives planned so far. Thread-safe
+  DeployProgress progress() const;
+
+  /// result of every archive in the order of the list, once all steps are done
+  std::vector<DeployResult> results() const;
+
+private:
+  struct State {
+    std::unique_ptr<ArchiveReader::Extraction> extraction;
+    // steps working on this archive right now
+    unsigned active{ 0 };
+    // no more work to start, because it's all claimed or the archive failed
+    bool exhausted{ false };
+    std::string error;
+  };
+
+private:
+  void plan(size_t job);
+  /// archive that gets the next batch, SIZE_MAX if there is none. Call with the mutex locked
+  size_t pickJob();
+  void fail(size_t job, const std::string &error);
+
+private:
+  std::vector<DeployJob> m_Jobs;
+  IOSchedule m_Schedule;
+  std::vector<State> m_States;
+  std::atomic<size_t> m_NextPlan{ 0 };
+  std::atomic<size_t> m_Planned{ 0 };
+  std::atomic<bool> m_Canceled{ false };
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_Changed;
+};
@@ -0,0 +1,104 @@
+#include "bsahandles.h"
+#include <algorithm>
+
+namespace {
+
+// well below the usual limit of 1024 descriptors per process
+const size_t DEFAULT_ARCHIVE_HANDLES = 256;
+
+}
+
+HandlePool::Pin::Pin(HandlePool &pool, Client *client)
+  : m_Pool(pool), m_Client(client)
+{
+  std::lock_guard<std::mutex> lock(pool.m_Mutex);
+  auto iter = pool.m_Entries.find(client);
+  if (iter != pool.m_Entries.end()) {
+    ++iter->second.pins;
+    pool.touch(iter->second);
+  }
+}
+
+HandlePool::Pin::~Pin() {
+  std::lock_guard<std::mutex> lock(m_Pool.m_Mutex);
+  auto iter = m_Pool.m_Entries.find(m_Client);
+  if (iter != m_Pool.m_Entries.end()) {
+    --iter->second.pins;
+    // the limit may have been exceeded while this handle was in use
+    m_Pool.trim();
+  }
+}
+
+HandlePool &HandlePool::archives() {
+  static HandlePool s_Pool(DEFAULT_ARCHIVE_HANDLES);
+  return s_Pool;
+}
+
+HandlePool::HandlePool(size_t limit)
+  : m_Limit(std::max<size_t>(limit, 1))
+{}
+
+void HandlePool::setLimit(size_t limit) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Limit = std::max<size_t>(limit, 1);
+  trim();
+}
+
+size_t HandlePool::limit() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Limit;
+}
+
+size_t HandlePool::numOpen() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Open;
+}
+
+void HandlePool::add(Client *client) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Recent.push_front(client);
+  Entry &entry = m_Entries[client];
+  entry.position = m_Recent.begin();
+  entry.open = true;
+  ++m_Open;
+  trim();
+}
+
+void HandlePool::remove(Client *client) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto iter = m_Entries.find(client);
+  if (iter == m_Entries.end()) {
+    return;
+  }
+  if (iter->second.open) {
+    --m_Open;
+  }
+  m_Recent.erase(iter->second.position);
+  m_Entries.erase(iter);
+}
+
+void HandlePool::reopened(Client *client) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto iter = m_Entries.find(client);
+  if ((iter != m_Entries.end()) && !iter->second.open) {
+    iter->second.open = true;
+    ++m_Open;
+    trim();
+  }
+}
+
+void HandlePool::touch(Entry &entry) {
+  m_Recent.splice(m_Recent.begin(), m_Recent, entry.position);
+  entry.position = m_Recent.begin();
+}
+
+void HandlePool::trim() {
+  for (auto iter = m_Recent.rbegin(); (m_Open > m_Limit) && (iter != m_Recent.rend()); ++iter) {
+    Entry &entry = m_Entries.find(*iter)->second;
+    if (entry.open && (entry.pins == 0)) {
+      (*iter)->evict();
+      entry.open = false;
+      --m_Open;
+    }
+  }
+}
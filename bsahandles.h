@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * limit on the file handles held open by archive sources. Once more than the limit
+ * are open the least recently used idle handle gets closed, its owner reopens it
+ * on the next read. Handles in use are never closed, so the limit can be exceeded
+ * while more sources than that are being read at the same time
+ */
+class HandlePool {
+public:
+  /// owner of a handle managed by the pool
+  class Client {
+  public:
+    virtual ~Client() {}
+
+  private:
+    friend class HandlePool;
+    /// close the idle handle. Called with the pool locked, mustn't call back into it
+    virtual void evict() = 0;
+  };
+
+  /**
+   * keeps the handle of a client from being closed while it's in use and marks it
+   * as recently used
+   */
+  class Pin {
+  public:
+    Pin(HandlePool &pool, Client *client);
+    ~Pin();
+    Pin(const Pin&) = delete;
+    Pin &operator=(const Pin&) = delete;
+
+  private:
+    HandlePool &m_Pool;
+    Client *m_Client;
+  };
+
+public:
+  /// pool for the files of all archives in the process
+  static HandlePool &archives();
+
+  explicit HandlePool(size_t limit);
+  HandlePool(const HandlePool&) = delete;
+  HandlePool &operator=(const HandlePool&) = delete;
+
+  /// change the limit, at least one handle is kept
+  void setLimit(size_t limit);
+  size_t limit() const;
+  size_t numOpen() const;
+
+  /// register a client whose handle was just opened
+  void add(Client *client);
+  /// unregister a client before it closes its handle for good
+  void remove(Client *client);
+  /// a pinned client reopened its handle
+  void reopened(Client *client);
+
+private:
+  struct Entry {
+    std::list<Client*>::iterator position;
+    unsigned pins{ 0 };
+    bool open{ false };
+  };
+
+private:
+  /// close idle handles until the limit is kept. Call with the mutex locked
+  void trim();
+  void touch(Entry &entry);
+
+private:
+  mutable std::mutex m_Mutex;
+  size_t m_Limit;
+  size_t m_Open{ 0 };
+  // most recently used first
+  std::list<Client*> m_Recent;
+  std::unordered_map<Client*, Entry> m_Entries;
+};
@@ -0,0 +1,618 @@
+#include "bsaindex.h"
+#include "bsapath.h"
+#include "bsasearch.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+static const uint32_t ARCHIVE_DIRNAMES = 0x1;
+static const uint32_t ARCHIVE_FILENAMES = 0x2;
+static const uint32_t ARCHIVE_COMPRESSED = 0x4;
+static const uint32_t ARCHIVE_EMBEDNAMES = 0x100;
+
+template <typename T> static T load(const uint8_t *data) {
+  T result;
+  memcpy(&result, data, sizeof(T));
+  return result;
+}
+
+static uint32_t hashString(const unsigned char *begin, const unsigned char *end) {
+  uint32_t hash = 0;
+  for (; begin < end; ++begin) {
+    hash = hash * 0x1003f + *begin;
+  }
+  return hash;
+}
+
+static uint64_t calculateHash(const unsigned char *begin, const unsigned char *ext,
+                              const unsigned char *end) {
+  uint32_t stemLength = static_cast<uint32_t>(ext - begin);
+  uint32_t hash1 = 0;
+  if (stemLength > 0) {
+    hash1 = *(ext - 1)
+          | ((stemLength > 2 ? *(ext - 2) : 0) << 8)
+          | (stemLength << 16)
+          | (*begin << 24);
+  }
+
+  size_t extLength = end - ext;
+  if ((extLength == 3) && (memcmp(ext, ".kf", 3) == 0)) {
+    hash1 |= 0x80;
+  } else if (extLength == 4) {
+    if (memcmp(ext, ".nif", 4) == 0) {
+      hash1 |= 0x8000;
+    } else if (memcmp(ext, ".dds", 4) == 0) {
+      hash1 |= 0x8080;
+    } else if (memcmp(ext, ".wav", 4) == 0) {
+      hash1 |= 0x80000000;
+    }
+  }
+
+  uint32_t hash2 = stemLength > 3 ? hashString(begin + 1, ext - 2) : 0;
+  hash2 += hashString(ext, end);
+
+  return (static_cast<uint64_t>(hash2) << 32) + hash1;
+}
+
+uint64_t calculateBSAHash(const char *name, size_t length) {
+  const unsigned char *begin = reinterpret_cast<const unsigned char*>(name);
+  const unsigned char *end = begin + length;
+  const unsigned char *ext = end;
+  for (const unsigned char *iter = end; iter > begin; --iter) {
+    if (*(iter - 1) == '.') {
+      ext = iter - 1;
+      break;
+    }
+  }
+  return calculateHash(begin, ext, end);
+}
+
+uint64_t calculateBSAFolderHash(const char *path, size_t length) {
+  const unsigned char *begin = reinterpret_cast<const unsigned char*>(path);
+  return calculateHash(begin, begin + length, begin + length);
+}
+
+namespace {
+
+// folder as collected while parsing, before the final arrays are allocated
+struct ParseFolder {
+  std::string_view path;
+  uint32_t parent;
+  uint32_t firstFile;
+  uint32_t numFiles;
+};
+
+class FolderBuilder {
+public:
+  explicit FolderBuilder(std::pmr::memory_resource *resource)
+    : m_Folders(resource), m_Lookup(resource), m_Resource(resource)
+  {
+    // root
+    m_Folders.push_back({ std::string_view(), ArchiveIndex::NO_PARENT, 0, 0 });
+  }
+
+  uint32_t findOrCreate(std::string_view path) {
+    if (path.empty()) {
+      return 0;
+    }
+
+    auto iter = m_Lookup.find(path);
+    if (iter != m_Lookup.end()) {
+      return iter->second;
+    }
+
+    size_t sep = path.find_last_of('\\');
+    uint32_t parent = sep == std::string_view::npos
+      ? 0
+      : findOrCreate(path.substr(0, sep));
+
+    // the view has to point to memory that lives as long as the builder
+    char *buffer = static_cast<char*>(m_Resource->allocate(path.size(), 1));
+    std::copy(path.begin(), path.end(), buffer);
+    std::string_view stored(buffer, path.size());
+
+    uint32_t id = static_cast<uint32_t>(m_Folders.size());
+    m_Folders.push_back({ stored, parent, 0, 0 });
+    m_Lookup[stored] = id;
+    return id;
+  }
+
+  std::pmr::vector<ParseFolder> &folders() { return m_Folders; }
+
+private:
+  std::pmr::vector<ParseFolder> m_Folders;
+  std::pmr::unordered_map<std::string_view, uint32_t> m_Lookup;
+  std::pmr::memory_resource *m_Resource;
+};
+
+template <typename T> size_t arraySize(size_t count) {
+  return count * sizeof(T) + alignof(T);
+}
+
+// fields of the fixed size header following the file id
+struct Header {
+  uint32_t version;
+  uint32_t recordOffset;
+  uint32_t archiveFlags;
+  uint32_t folderCount;
+  uint32_t fileCount;
+  uint32_t totalFolderNameLength;
+  uint32_t totalFileNameLength;
+};
+
+Header decodeHeader(const uint8_t *data, size_t size) {
+  if ((size < ArchiveIndex::HEADER_SIZE) || (memcmp(data, "BSA\0", 4) != 0)) {
+    throw std::runtime_error("invalid data");
+  }
+  Header header;
+  header.version = load<uint32_t>(data + 4);
+  header.recordOffset = load<uint32_t>(data + 8);
+  header.archiveFlags = load<uint32_t>(data + 12);
+  header.folderCount = load<uint32_t>(data + 16);
+  header.fileCount = load<uint32_t>(data + 20);
+  header.totalFolderNameLength = load<uint32_t>(data + 24);
+  header.totalFileNameLength = load<uint32_t>(data + 28);
+  if ((header.version != ArchiveIndex::VERSION_OBLIVION)
+      && (header.version != ArchiveIndex::VERSION_SKYRIM)
+      && (header.version != ArchiveIndex::VERSION_SKYRIMSE)) {
+    throw std::runtime_error("invalid data");
+  }
+  return header;
+}
+
+/**
+ * record layout of an archive version. Folder records only differ in the size of
+ * the offset field, skyrim se pads it to 64 bit. File records are the same in all
+ * versions: hash, size, offset
+ */
+template <uint32_t Version> struct RecordLayout {
+  static constexpr size_t FOLDER_RECORD = 16;
+  static constexpr size_t FILE_RECORD = 16;
+};
+
+template <> struct RecordLayout<ArchiveIndex::VERSION_SKYRIMSE> {
+  static constexpr size_t FOLDER_RECORD = 24;
+  static constexpr size_t FILE_RECORD = 16;
+};
+
+size_t folderRecordSize(uint32_t version) {
+  return version == ArchiveIndex::VERSION_SKYRIMSE
+    ? RecordLayout<ArchiveIndex::VERSION_SKYRIMSE>::FOLDER_RECORD
+    : RecordLayout<ArchiveIndex::VERSION_SKYRIM>::FOLDER_RECORD;
+}
+
+/// bounds checked position in the index data
+class RecordCursor {
+public:
+  RecordCursor(const uint8_t *data, size_t size, size_t offset)
+    : m_Pos(data + offset), m_End(data + size)
+  {
+    if (offset > size) {
+      throw std::runtime_error("invalid data");
+    }
+  }
+
+  /// pointer to the next count bytes, which are skipped
+  const uint8_t *take(size_t count) {
+    if (count > static_cast<size_t>(m_End - m_Pos)) {
+      throw std::runtime_error("invalid data");
+    }
+    const uint8_t *result = m_Pos;
+    m_Pos += count;
+    return result;
+  }
+
+private:
+  const uint8_t *m_Pos;
+  const uint8_t *m_End;
+};
+
+struct SerializedHeader {
+  char magic[4];
+  uint32_t layoutVersion;
+  uint32_t version;
+  uint32_t archiveFlags;
+  uint32_t numFolders;
+  uint32_t numFiles;
+  uint32_t namesSize;
+  uint32_t reserved;
+  uint64_t totalSize;
+};
+
+const uint32_t SERIALIZED_LAYOUT = 1;
+
+// every array in the serialized form starts 8-byte aligned
+size_t alignSerialized(size_t offset) {
+  return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+}
+
+size_t ArchiveIndex::indexSize(const uint8_t *header, size_t size) {
+  Header fields = decodeHeader(header, size);
+  uint64_t result = static_cast<uint64_t>(fields.recordOffset)
+    + static_cast<uint64_t>(fields.folderCount) * folderRecordSize(fields.version)
+    + static_cast<uint64_t>(fields.fileCount) * RecordLayout<VERSION_SKYRIM>::FILE_RECORD;
+  if ((fields.archiveFlags & ARCHIVE_DIRNAMES) != 0) {
+    // each name is prefixed by its length
+    result += static_cast<uint64_t>(fields.folderCount) + fields.totalFolderNameLength;
+  }
+  if ((fields.archiveFlags & ARCHIVE_FILENAMES) != 0) {
+    result += fields.totalFileNameLength;
+  }
+  if (result > SIZE_MAX) {
+    throw std::runtime_error("invalid data");
+  }
+  return static_cast<size_t>(result);
+}
+
+ArchiveIndex::ArchiveIndex() {
+}
+
+ArchiveIndex::~ArchiveIndex() {
+  if (m_Arena && (m_Names != nullptr)) {
+    // the arena gets returned as a whole
+    m_Memory.rebook(MemoryCategory::NAMES, MemoryCategory::INDEX, m_NamesSize);
+  }
+}
+
+void ArchiveIndex::parse(const uint8_t *data, size_t size, bool testHashes) {
+  Header header = decodeHeader(data, size);
+  m_Version = header.version;
+  m_ArchiveFlags = header.archiveFlags;
+  if (m_Version == VERSION_SKYRIMSE) {
+    parseRecords<VERSION_SKYRIMSE>(data, size, testHashes);
+  } else {
+    parseRecords<VERSION_SKYRIM>(data, size, testHashes);
+  }
+}
+
+template <uint32_t Version>
+void ArchiveIndex::parseRecords(const uint8_t *data, size_t size, bool testHashes) {
+  typedef RecordLayout<Version> Layout;
+  Header header = decodeHeader(data, size);
+  uint32_t folderCount = header.folderCount;
+  uint32_t fileCount = header.fileCount;
+  RecordCursor cursor(data, size, header.recordOffset);
+
+  // everything that is only needed while parsing goes into a scratch arena
+  // that is released as a whole when we're done
+  std::pmr::monotonic_buffer_resource scratch(
+    folderCount * 64 + header.totalFolderNameLength * 2);
+
+  const uint8_t *folderRecords = cursor.take(static_cast<size_t>(folderCount) * Layout::FOLDER_RECORD);
+
+  FolderBuilder builder(&scratch);
+  // file records of each folder, they get decoded once the final arrays exist
+  std::pmr::vector<const uint8_t*> fileRecords(folderCount, &scratch);
+  std::pmr::vector<uint32_t> recordFolders(folderCount, &scratch);
+  uint32_t numFiles = 0;
+
+  bool dirNames = (m_ArchiveFlags & ARCHIVE_DIRNAMES) != 0;
+  // stored names may use any case and forward slashes, hashes are computed from
+  // their canonical form
+  std::string canonical;
+  for (uint32_t i = 0; i < folderCount; ++i) {
+    const uint8_t *record = folderRecords + i * Layout::FOLDER_RECORD;
+    uint32_t folderFileCount = load<uint32_t>(record + 8);
+
+    std::string_view path;
+    if (dirNames) {
+      uint8_t length = *cursor.take(1);
+      path = std::string_view(reinterpret_cast<const char*>(cursor.take(length)), length);
+      // stored names are zero terminated
+      while (!path.empty() && (path.back() == '\0')) {
+        path.remove_suffix(1);
+      }
+      if (testHashes) {
+        canonical.assign(path.data(), path.size());
+        canonicalizePath(&canonical[0], canonical.size());
+        if (calculateBSAFolderHash(canonical.data(), canonical.size()) != load<uint64_t>(record)) {
+          throw std::runtime_error("invalid hashes");
+        }
+      }
+      if (path == ".") {
+        path = std::string_view();
+      }
+    }
+
+    uint32_t folder = builder.findOrCreate(path);
+    ParseFolder &folderInfo = builder.folders()[folder];
+    if ((folderInfo.numFiles != 0) || (folderFileCount > fileCount - numFiles)) {
+      // folder listed twice or more files than declared
+      throw std::runtime_error("invalid data");
+    }
+    folderInfo.firstFile = numFiles;
+    folderInfo.numFiles = folderFileCount;
+    fileRecords[i] = cursor.take(static_cast<size_t>(folderFileCount) * Layout::FILE_RECORD);
+    recordFolders[i] = folder;
+    numFiles += folderFileCount;
+  }
+
+  if (numFiles != fileCount) {
+    throw std::runtime_error("invalid data");
+  }
+
+  const char *nameBlock = nullptr;
+  size_t nameBlockSize = 0;
+  if ((m_ArchiveFlags & ARCHIVE_FILENAMES) != 0) {
+    nameBlockSize = header.totalFileNameLength;
+    nameBlock = reinterpret_cast<const char*>(cursor.take(nameBlockSize));
+  }
+
+  const std::pmr::vector<ParseFolder> &folders = builder.folders();
+  m_NumFolders = static_cast<uint32_t>(folders.size());
+  m_NumFiles = fileCount;
+
+  size_t namesSize = nameBlockSize;
+  for (const ParseFolder &folder : folders) {
+    namesSize += folder.path.size();
+  }
+  m_NamesSize = static_cast<uint32_t>(namesSize);
+
+  size_t arenaSize = arraySize<char>(namesSize)
+    + arraySize<uint32_t>(m_NumFolders) * 6 + arraySize<uint16_t>(m_NumFolders) * 2
+    + arraySize<uint32_t>(m_NumFolders)
+    + arraySize<uint32_t>(m_NumFiles) * 3 + arraySize<uint16_t>(m_NumFiles)
+    + arraySize<uint64_t>(m_NumFiles) * 2;
+  m_Arena.reset(new std::pmr::monotonic_buffer_resource(arenaSize, &m_ArenaUpstream));
+
+  m_Names = allocate<char>(namesSize);
+  // the name pool shares the arena but is reported on its own
+  m_Memory.rebook(MemoryCategory::INDEX, MemoryCategory::NAMES, namesSize);
+  size_t namesOffset = 0;
+
+  m_FolderPathOffset = allocate<uint32_t>(m_NumFolders);
+  m_FolderPathLength = allocate<uint16_t>(m_NumFolders);
+  m_FolderNameStart = allocate<uint16_t>(m_NumFolders);
+  m_FolderParent = allocate<uint32_t>(m_NumFolders);
+  m_FolderFirstFile = allocate<uint32_t>(m_NumFolders);
+  m_FolderNumFiles = allocate<uint32_t>(m_NumFolders);
+  for (uint32_t i = 0; i < m_NumFolders; ++i) {
+    const ParseFolder &folder = folders[i];
+    size_t sep = folder.path.find_last_of('\\');
+    m_FolderPathOffset[i] = static_cast<uint32_t>(namesOffset);
+    m_FolderPathLength[i] = static_cast<uint16_t>(folder.path.size());
+    m_FolderNameStart[i] = static_cast<uint16_t>(sep == std::string_view::npos ? 0 : sep + 1);
+    m_FolderParent[i] = folder.parent;
+    m_FolderFirstFile[i] = folder.firstFile;
+    m_FolderNumFiles[i] = folder.numFiles;
+    std::copy(folder.path.begin(), folder.path.end(), m_Names + namesOffset);
+    namesOffset += folder.path.size();
+  }
+
+  m_FileNameOffset = allocate<uint32_t>(m_NumFiles);
+  m_FileNameLength = allocate<uint16_t>(m_NumFiles);
+  m_FileFolder = allocate<uint32_t>(m_NumFiles);
+  m_FileSize = allocate<uint32_t>(m_NumFiles);
+  m_FileOffset = allocate<uint64_t>(m_NumFiles);
+  m_FileHash = allocate<uint64_t>(m_NumFiles);
+
+  // the record blocks were bounds checked as a whole, decoding them is a straight
+  // copy into the arrays
+  for (uint32_t i = 0; i < folderCount; ++i) {
+    uint32_t folder = recordFolders[i];
+    uint32_t first = m_FolderFirstFile[folder];
+    const uint8_t *record = fileRecords[i];
+    for (uint32_t file = first; file < first + m_FolderNumFiles[folder]; ++file) {
+      m_FileHash[file] = load<uint64_t>(record);
+      m_FileSize[file] = load<uint32_t>(record + 8);
+      m_FileOffset[file] = load<uint32_t>(record + 12);
+      m_FileFolder[file] = folder;
+      record += Layout::FILE_RECORD;
+    }
+  }
+
+  size_t pos = 0;
+  for (uint32_t i = 0; i < m_NumFiles; ++i) {
+    size_t length = 0;
+    if (nameBlockSize > 0) {
+      length = strnlen(nameBlock + pos, nameBlockSize - pos);
+      if (pos + length >= nameBlockSize) {
+        throw std::runtime_error("invalid data");
+      }
+      if (testHashes) {
+        canonical.assign(nameBlock + pos, length);
+        canonicalizePath(&canonical[0], canonical.size());
+        if (calculateBSAHash(canonical.data(), canonical.size()) != m_FileHash[i]) {
+          throw std::runtime_error("invalid hashes");
+        }
+      }
+    }
+    m_FileNameOffset[i] = static_cast<uint32_t>(namesOffset);
+    m_FileNameLength[i] = static_cast<uint16_t>(length);
+    std::copy(nameBlock + pos, nameBlock + pos + length, m_Names + namesOffset);
+    namesOffset += length;
+    pos += length + 1;
+  }
+
+  linkFolders();
+}
+
+void ArchiveIndex::linkFolders() {
+  uint32_t count = m_NumFolders;
+  m_FolderFirstChild = allocate<uint32_t>(count);
+  m_FolderNumChildren = allocate<uint32_t>(count);
+  m_Children = allocate<uint32_t>(count);
+  std::fill(m_FolderNumChildren, m_FolderNumChildren + count, 0);
+  for (uint32_t i = 1; i < count; ++i) {
+    ++m_FolderNumChildren[m_FolderParent[i]];
+  }
+
+  // first child offsets start out pointing past the end of each group and are
+  // moved to the front while the group gets filled back to front. Folder ids are
+  // assigned in order of appearance so this keeps subfolders in archive order
+  uint32_t offset = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    offset += m_FolderNumChildren[i];
+    m_FolderFirstChild[i] = offset;
+  }
+
+  for (uint32_t i = count - 1; i > 0; --i) {
+    m_Children[--m_FolderFirstChild[m_FolderParent[i]]] = i;
+  }
+}
+
+bool ArchiveIndex::embeddedNames() const {
+  return (m_Version != VERSION_OBLIVION) && ((m_ArchiveFlags & ARCHIVE_EMBEDNAMES) != 0);
+}
+
+std::string ArchiveIndex::folderName(uint32_t folder) const {
+  const char *path = m_Names + m_FolderPathOffset[folder];
+  return std::string(path + m_FolderNameStart[folder], path + m_FolderPathLength[folder]);
+}
+
+std::string ArchiveIndex::folderPath(uint32_t folder) const {
+  const char *path = m_Names + m_FolderPathOffset[folder];
+  return std::string(path, path + m_FolderPathLength[folder]);
+}
+
+uint32_t ArchiveIndex::countFiles(uint32_t folder) const {
+  uint32_t result = 0;
+  std::vector<uint32_t> stack{ folder };
+  while (!stack.empty()) {
+    uint32_t cur = stack.back();
+    stack.pop_back();
+    result += m_FolderNumFiles[cur];
+    for (uint32_t i = 0; i < m_FolderNumChildren[cur]; ++i) {
+      stack.push_back(m_Children[m_FolderFirstChild[cur] + i]);
+    }
+  }
+  return result;
+}
+
+std::string ArchiveIndex::fileName(uint32_t file) const {
+  const char *name = m_Names + m_FileNameOffset[file];
+  return std::string(name, name + m_FileNameLength[file]);
+}
+
+std::string ArchiveIndex::filePath(uint32_t file) const {
+  std::string result = folderPath(m_FileFolder[file]);
+  if (!result.empty()) {
+    result.push_back('\\');
+  }
+  return result + fileName(file);
+}
+
+bool ArchiveIndex::fileCompressed(uint32_t file) const {
+  bool defaultCompressed = (m_ArchiveFlags & ARCHIVE_COMPRESSED) != 0;
+  return defaultCompressed != ((m_FileSize[file] & SIZE_COMPRESSTOGGLE) != 0);
+}
+
+const PathIndex &ArchiveIndex::pathIndex() const {
+  std::call_once(m_PathIndexInit, [this]() {
+    m_PathIndex.reset(new PathIndex(*this, &m_CacheResource));
+  });
+  return *m_PathIndex;
+}
+
+size_t ArchiveIndex::serializedSize() const {
+  size_t result = sizeof(SerializedHeader);
+  visitArrays(*this, [&result](const auto &array, size_t count) {
+    result = alignSerialized(result) + count * sizeof(*array);
+  });
+  return alignSerialized(result);
+}
+
+void ArchiveIndex::serialize(uint8_t *buffer) const {
+  SerializedHeader header{};
+  memcpy(header.magic, "BSAI", 4);
+  header.layoutVersion = SERIALIZED_LAYOUT;
+  header.version = m_Version;
+  header.archiveFlags = m_ArchiveFlags;
+  header.numFolders = m_NumFolders;
+  header.numFiles = m_NumFiles;
+  header.namesSize = m_NamesSize;
+  header.totalSize = serializedSize();
+  memcpy(buffer, &header, sizeof(SerializedHeader));
+
+  size_t offset = sizeof(SerializedHeader);
+  visitArrays(*this, [&](const auto &array, size_t count) {
+    offset = alignSerialized(offset);
+    memcpy(buffer + offset, array, count * sizeof(*array));
+    offset += count * sizeof(*array);
+  });
+}
+
+void ArchiveIndex::deserialize(const uint8_t *buffer, size_t size, std::shared_ptr<const void> storage) {
+  SerializedHeader header;
+  if (size < sizeof(SerializedHeader)) {
+    throw std::runtime_error("invalid data");
+  }
+  memcpy(&header, buffer, sizeof(SerializedHeader));
+  if ((memcmp(header.magic, "BSAI", 4) != 0)
+      || (header.layoutVersion != SERIALIZED_LAYOUT)
+      || (header.totalSize > size)
+      || ((reinterpret_cast<uintptr_t>(buffer) & 7) != 0)) {
+    throw std::runtime_error("invalid data");
+  }
+
+  m_Version = header.version;
+  m_ArchiveFlags = header.archiveFlags;
+  m_NumFolders = header.numFolders;
+  m_NumFiles = header.numFiles;
+  m_NamesSize = header.namesSize;
+
+  size_t offset = sizeof(SerializedHeader);
+  visitArrays(*this, [&](auto &array, size_t count) {
+    offset = alignSerialized(offset);
+    if (offset + count * sizeof(*array) > header.totalSize) {
+      throw std::runtime_error("invalid data");
+    }
+    // the arrays are only written to during parsing, a deserialized index is
+    // never modified
+    array = reinterpret_cast<std::remove_reference_t<decltype(array)>>(
+      const_cast<uint8_t*>(buffer + offset));
+    offset += count * sizeof(*array);
+  });
+
+  // the buffer may come from another process, everything the accessors index
+  // with has to be checked the way parsing does
+  validate();
+
+  m_Storage = storage;
+}
+
+void ArchiveIndex::validate() const {
+  // folder 0 is the root, every other folder comes after its parent
+  if ((m_NumFolders == 0) || (m_FolderParent[0] != NO_PARENT)) {
+    throw std::runtime_error("invalid data");
+  }
+
+  uint64_t numFiles = 0;
+  for (uint32_t i = 0; i < m_NumFolders; ++i) {
+    if ((static_cast<uint64_t>(m_FolderPathOffset[i]) + m_FolderPathLength[i] > m_NamesSize)
+        || (m_FolderNameStart[i] > m_FolderPathLength[i])
+        || ((i > 0) && (m_FolderParent[i] >= i))
+        || (static_cast<uint64_t>(m_FolderFirstChild[i]) + m_FolderNumChildren[i] > m_NumFolders)
+        || (static_cast<uint64_t>(m_FolderFirstFile[i]) + m_FolderNumFiles[i] > m_NumFiles)) {
+      throw std::runtime_error("invalid data");
+    }
+    for (uint32_t idx = 0; idx < m_FolderNumChildren[i]; ++idx) {
+      uint32_t child = m_Children[m_FolderFirstChild[i] + idx];
+      if ((child >= m_NumFolders) || (child == 0) || (m_FolderParent[child] != i)) {
+        throw std::runtime_error("invalid data");
+      }
+    }
+    for (uint32_t file = m_FolderFirstFile[i]; file < m_FolderFirstFile[i] + m_FolderNumFiles[i]; ++file) {
+      if (m_FileFolder[file] != i) {
+        // file listed in two folders
+        throw std::runtime_error("invalid data");
+      }
+    }
+    numFiles += m_FolderNumFiles[i];
+  }
+
+  if (numFiles != m_NumFiles) {
+    throw std::runtime_error("invalid data");
+  }
+
+  for (uint32_t i = 0; i < m_NumFiles; ++i) {
+    if (static_cast<uint64_t>(m_FileNameOffset[i]) + m_FileNameLength[i] > m_NamesSize) {
+      throw std::runtime_error("invalid data");
+    }
+  }
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstddef>
+#include "bsamemory.h"
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+class PathIndex;
+
+/**
+ * flat, read-only index of a parsed bsa. Folders and files are stored as
+ * parallel arrays (struct-of-arrays) and reference each other by index, names
+ * are kept in a single character pool.
+ * The folder hierarchy is reconstructed from the folder paths stored in the
+ * archive, intermediate folders that contain no files themselves are created
+ * as needed. Folder 0 is always the (unnamed) root.
+ * All arrays are carved from a single arena that is sized once the record counts
+ * are known so parsing does one large allocation and destroying the index frees
+ * it in one go.
+ */
+class ArchiveIndex {
+public:
+  static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+  static constexpr uint32_t VERSION_OBLIVION = 0x67;
+  static constexpr uint32_t VERSION_SKYRIM = 0x68;
+  static constexpr uint32_t VERSION_SKYRIMSE = 0x69;
+
+public:
+  ArchiveIndex();
+  ~ArchiveIndex();
+  ArchiveIndex(const ArchiveIndex&) = delete;
+  ArchiveIndex &operator=(const ArchiveIndex&) = delete;
+
+  /// size of the fixed header at the start of every bsa
+  static constexpr size_t HEADER_SIZE = 36;
+
+  /**
+   * number of bytes from the start of the archive needed to parse its index
+   * @param header at least HEADER_SIZE bytes
+   * @throws std::runtime_error if the data is not a supported bsa
+   */
+  static size_t indexSize(const uint8_t *header, size_t size);
+
+  /**
+   * parse the header, folder- and file records from the start of the archive,
+   * data has to hold at least indexSize bytes
+   * @throws std::runtime_error if the data is not a supported bsa or, with
+   *         testHashes set, if a stored hash doesn't match its name
+   */
+  void parse(const uint8_t *data, size_t size, bool testHashes);
+
+  /**
+   * size of the serialized form of the index. The serialized form contains only
+   * offsets and indices so it can be used at any address, e.g. in shared memory
+   */
+  size_t serializedSize() const;
+  void serialize(uint8_t *buffer) const;
+  /**
+   * use a serialized index in place, without copying. storage is kept alive for
+   * as long as the index exists, the buffer is never written to
+   * @throws std::runtime_error if the buffer doesn't contain a valid index
+   */
+  void deserialize(const uint8_t *buffer, size_t size, std::shared_ptr<const void> storage);
+
+  uint32_t version() const { return m_Version; }
+  uint32_t archiveFlags() const { return m_ArchiveFlags; }
+  /// true if file data is prefixed by the full file path
+  bool embeddedNames() const;
+
+  uint32_t numFolders() const { return m_NumFolders; }
+  uint32_t numFiles() const { return m_NumFiles; }
+
+  std::string folderName(uint32_t folder) const;
+  std::string folderPath(uint32_t folder) const;
+  std::string_view folderPathView(uint32_t folder) const {
+    return std::string_view(m_Names + m_FolderPathOffset[folder], m_FolderPathLength[folder]);
+  }
+  uint32_t folderParent(uint32_t folder) const { return m_FolderParent[folder]; }
+  uint32_t numSubFolders(uint32_t folder) const { return m_FolderNumChildren[folder]; }
+  uint32_t subFolder(uint32_t folder, uint32_t idx) const {
+    return m_Children[m_FolderFirstChild[folder] + idx];
+  }
+  uint32_t numFolderFiles(uint32_t folder) const { return m_FolderNumFiles[folder]; }
+  uint32_t folderFile(uint32_t folder, uint32_t idx) const { return m_FolderFirstFile[folder] + idx; }
+  /// number of files in this folder and all its subfolders
+  uint32_t countFiles(uint32_t folder) const;
+
+  std::string fileName(uint32_t file) const;
+  std::string_view fileNameView(uint32_t file) const {
+    return std::string_view(m_Names + m_FileNameOffset[file], m_FileNameLength[file]);
+  }
+  std::string filePath(uint32_t file) const;
+  uint32_t fileFolder(uint32_t file) const { return m_FileFolder[file]; }
+  /// size of the record as stored in the archive (including any prefix)
+  uint32_t fileSize(uint32_t file) const { return m_FileSize[file] & SIZE_MASK; }
+  uint64_t fileOffset(uint32_t file) const { return m_FileOffset[file]; }
+  uint64_t fileHash(uint32_t file) const { return m_FileHash[file]; }
+  bool fileCompressed(uint32_t file) const;
+
+  /// path lookup structure, built on first use
+  const PathIndex &pathIndex() const;
+
+  /// native memory held by the index and its lookup structures
+  const MemoryAccount &memory() const { return m_Memory; }
+  MemoryAccount &memory() { return m_Memory; }
+
+private:
+  static constexpr uint32_t SIZE_MASK = 0x3FFFFFFF;
+  static constexpr uint32_t SIZE_COMPRESSTOGGLE = 0x40000000;
+
+  template <typename T> T *allocate(size_t count) {
+    return static_cast<T*>(m_Arena->allocate(count * sizeof(T), alignof(T)));
+  }
+
+  /// records are decoded with the layout of the version fixed at compile time
+  template <uint32_t Version> void parseRecords(const uint8_t *data, size_t size, bool testHashes);
+  void linkFolders();
+  /// check that the names, links and file ranges of a deserialized index stay within its arrays
+  void validate() const;
+
+  template <typename Self, typename Func> static void visitArrays(Self &self, Func &&func) {
+    func(self.m_Names, self.m_NamesSize);
+    func(self.m_FolderPathOffset, self.m_NumFolders);
+    func(self.m_FolderPathLength, self.m_NumFolders);
+    func(self.m_FolderNameStart, self.m_NumFolders);
+    func(self.m_FolderParent, self.m_NumFolders);
+    func(self.m_FolderFirstChild, self.m_NumFolders);
+    func(self.m_FolderNumChildren, self.m_NumFolders);
+    func(self.m_FolderFirstFile, self.m_NumFolders);
+    func(self.m_FolderNumFiles, self.m_NumFolders);
+    func(self.m_Children, self.m_NumFolders);
+    func(self.m_FileNameOffset, self.m_NumFiles);
+    func(self.m_FileNameLength, self.m_NumFiles);
+    func(self.m_FileFolder, self.m_NumFiles);
+    func(self.m_FileSize, self.m_NumFiles);
+    func(self.m_FileOffset, self.m_NumFiles);
+    func(self.m_FileHash, self.m_NumFiles);
+  }
+
+private:
+  uint32_t m_Version{ 0 };
+  uint32_t m_ArchiveFlags{ 0 };
+  uint32_t m_NumFolders{ 0 };
+  uint32_t m_NumFiles{ 0 };
+  uint32_t m_NamesSize{ 0 };
+
+  // charged with the arena and the lookup structures, not with the storage of
+  // deserialized indexes
+  MemoryAccount m_Memory;
+  CountingResource m_ArenaUpstream{ m_Memory, MemoryCategory::INDEX };
+  mutable CountingResource m_CacheResource{ m_Memory, MemoryCategory::CACHES };
+
+  // owns the arrays, either the arena they were allocated from during parsing
+  // or the buffer they were deserialized from
+  std::unique_ptr<std::pmr::monotonic_buffer_resource> m_Arena;
+  std::shared_ptr<const void> m_Storage;
+
+  // name pool, both folder paths and file names are stored here
+  char *m_Names{ nullptr };
+
+  // folders
+  uint32_t *m_FolderPathOffset{ nullptr };
+  uint16_t *m_FolderPathLength{ nullptr };
+  uint16_t *m_FolderNameStart{ nullptr };
+  uint32_t *m_FolderParent{ nullptr };
+  uint32_t *m_FolderFirstChild{ nullptr };
+  uint32_t *m_FolderNumChildren{ nullptr };
+  uint32_t *m_FolderFirstFile{ nullptr };
+  uint32_t *m_FolderNumFiles{ nullptr };
+
+  // subfolder ids, grouped by parent
+  uint32_t *m_Children{ nullptr };
+
+  // files
+  uint32_t *m_FileNameOffset{ nullptr };
+  uint16_t *m_FileNameLength{ nullptr };
+  uint32_t *m_FileFolder{ nullptr };
+  uint32_t *m_FileSize{ nullptr };
+  uint64_t *m_FileOffset{ nullptr };
+  uint64_t *m_FileHash{ nullptr };
+
+  mutable std::once_flag m_PathIndexInit;
+  mutable std::unique_ptr<PathIndex> m_PathIndex;
+};
+
+/**
+ * calculate the hashes bsas use to identify files and folders. Names are
+ * expected to be lower case with backslashes as separators
+ */
+uint64_t calculateBSAHash(const char *fileName, size_t length);
+uint64_t calculateBSAFolderHash(const char *path, size_t length);
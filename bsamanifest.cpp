@@ -0,0 +1,112 @@
+#include "bsamanifest.h"
+#include "bsaindex.h"
+#include "bsasource.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+const uint32_t BINARY_VERSION = 1;
+const uint32_t FLAG_DIGESTS = 1;
+
+std::ofstream openOutput(const std::string &fileName) {
+  std::ofstream result(toNativePath(fileName), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!result.is_open()) {
+    throw std::runtime_error("access failed");
+  }
+  return result;
+}
+
+void closeOutput(std::ofstream &file) {
+  file.close();
+  if (file.fail()) {
+    throw std::runtime_error("access failed");
+  }
+}
+
+void appendJSONString(std::string &output, const std::string &value) {
+  static const char HEX[] = "0123456789abcdef";
+  output += '"';
+  for (char ch : value) {
+    if ((ch == '"') || (ch == '\\')) {
+      output += '\\';
+      output += ch;
+    } else if (static_cast<unsigned char>(ch) < 0x20) {
+      output += "\\u00";
+      output += HEX[(ch >> 4) & 0xF];
+      output += HEX[ch & 0xF];
+    } else {
+      output += ch;
+    }
+  }
+  output += '"';
+}
+
+template <typename T> void appendBinary(std::string &output, T value) {
+  char bytes[sizeof(T)];
+  memcpy(bytes, &value, sizeof(T));
+  output.append(bytes, sizeof(T));
+}
+
+}
+
+void ExtractionManifest::add(uint32_t file, uint64_t size, uint32_t crc32) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Entries.push_back({ file, size, m_Digests ? crc32 : 0 });
+}
+
+std::vector<ManifestEntry> ExtractionManifest::entries() const {
+  std::vector<ManifestEntry> result;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    result = m_Entries;
+  }
+  std::sort(result.begin(), result.end(), [](const ManifestEntry &lhs, const ManifestEntry &rhs) {
+    return lhs.file < rhs.file;
+  });
+  return result;
+}
+
+void ExtractionManifest::writeNDJSON(const ArchiveIndex &index, const std::string &fileName) const {
+  std::ofstream file = openOutput(fileName);
+  std::string line;
+  for (const ManifestEntry &entry : entries()) {
+    line = "{\"path\":";
+    appendJSONString(line, index.filePath(entry.file));
+    line += ",\"size\":" + std::to_string(entry.size);
+    if (m_Digests) {
+      line += ",\"crc32\":" + std::to_string(entry.crc32);
+    }
+    line += "}\n";
+    if (!file.write(line.data(), line.size())) {
+      throw std::runtime_error("access failed");
+    }
+  }
+  closeOutput(file);
+}
+
+void ExtractionManifest::writeBinary(const ArchiveIndex &index, const std::string &fileName) const {
+  std::vector<ManifestEntry> sorted = entries();
+  std::string output("BSAM");
+  appendBinary<uint32_t>(output, BINARY_VERSION);
+  appendBinary<uint32_t>(output, m_Digests ? FLAG_DIGESTS : 0);
+  appendBinary<uint32_t>(output, static_cast<uint32_t>(sorted.size()));
+  for (const ManifestEntry &entry : sorted) {
+    std::string path = index.filePath(entry.file);
+    appendBinary<uint64_t>(output, entry.size);
+    if (m_Digests) {
+      appendBinary<uint32_t>(output, entry.crc32);
+    }
+    // folder and file names are limited to 255 characters each
+    appendBinary<uint16_t>(output, static_cast<uint16_t>(path.size()));
+    output += path;
+  }
+
+  std::ofstream file = openOutput(fileName);
+  if (!file.write(output.data(), output.size())) {
+    throw std::runtime_error("access failed");
+  }
+  closeOutput(file);
+}
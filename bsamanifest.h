@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ArchiveIndex;
+
+/// a file produced by an extraction
+struct ManifestEntry {
+  uint32_t file;
+  /// size of the extracted content
+  uint64_t size;
+  /// crc32 of the extracted content, 0 if digests weren't requested
+  uint32_t crc32;
+};
+
+/**
+ * list of the files an extraction produced, with their sizes and optionally
+ * their crc32, computed from the data as it gets written so the output doesn't
+ * have to be read again. Entries are added from the threads running the extraction
+ */
+class ExtractionManifest {
+public:
+  explicit ExtractionManifest(bool digests) : m_Digests(digests) {}
+
+  bool digests() const { return m_Digests; }
+
+  void add(uint32_t file, uint64_t size, uint32_t crc32);
+
+  /// entries ordered by file id
+  std::vector<ManifestEntry> entries() const;
+
+  /**
+   * one json object per line: {"path":...,"size":...} plus "crc32" with digests.
+   * Paths are relative to the output directory, with backslashes
+   * @throws std::runtime_error
+   */
+  void writeNDJSON(const ArchiveIndex &index, const std::string &fileName) const;
+
+  /**
+   * "BSAM", format version, flags (1 = digests) and entry count as uint32, then per
+   * entry the size as uint64, crc32 as uint32 if present, path length as uint16 and
+   * the path. All little endian
+   * @throws std::runtime_error
+   */
+  void writeBinary(const ArchiveIndex &index, const std::string &fileName) const;
+
+private:
+  bool m_Digests;
+  mutable std::mutex m_Mutex;
+  std::vector<ManifestEntry> m_Entries;
+};
@@ -0,0 +1,108 @@
+#include "bsamemory.h"
+
+MemoryAccount &MemoryAccount::process() {
+  // never destroyed, accounts of static objects may outlive it otherwise
+  static MemoryAccount *s_Process = new MemoryAccount(nullptr);
+  return *s_Process;
+}
+
+MemoryAccount::MemoryAccount()
+  : MemoryAccount(&process())
+{
+  std::lock_guard<std::mutex> lock(m_Parent->m_Mutex);
+  m_Next = m_Parent->m_First;
+  if (m_Next != nullptr) {
+    m_Next->m_Previous = this;
+  }
+  m_Parent->m_First = this;
+}
+
+MemoryAccount::MemoryAccount(MemoryAccount *parent)
+  : m_Parent(parent)
+{
+  for (std::atomic<uint64_t> &used : m_Used) {
+    used.store(0, std::memory_order_relaxed);
+  }
+}
+
+MemoryAccount::~MemoryAccount() {
+  if (m_Parent == nullptr) {
+    return;
+  }
+  // whatever the owner didn't return is gone with it
+  for (size_t i = 0; i < NUM_CATEGORIES; ++i) {
+    m_Parent->credit(static_cast<MemoryCategory>(i), m_Used[i].load(std::memory_order_relaxed));
+  }
+  std::lock_guard<std::mutex> lock(m_Parent->m_Mutex);
+  if (m_Previous != nullptr) {
+    m_Previous->m_Next = m_Next;
+  } else {
+    m_Parent->m_First = m_Next;
+  }
+  if (m_Next != nullptr) {
+    m_Next->m_Previous = m_Previous;
+  }
+}
+
+void MemoryAccount::charge(MemoryCategory category, uint64_t size) {
+  m_Used[static_cast<size_t>(category)].fetch_add(size, std::memory_order_relaxed);
+  if (m_Parent != nullptr) {
+    m_Parent->charge(category, size);
+  }
+}
+
+void MemoryAccount::credit(MemoryCategory category, uint64_t size) {
+  m_Used[static_cast<size_t>(category)].fetch_sub(size, std::memory_order_relaxed);
+  if (m_Parent != nullptr) {
+    m_Parent->credit(category, size);
+  }
+}
+
+void MemoryAccount::rebook(MemoryCategory from, MemoryCategory to, uint64_t size) {
+  charge(to, size);
+  credit(from, size);
+}
+
+uint64_t MemoryAccount::used(MemoryCategory category) const {
+  return m_Used[static_cast<size_t>(category)].load(std::memory_order_relaxed);
+}
+
+uint64_t MemoryAccount::total() const {
+  uint64_t result = 0;
+  for (const std::atomic<uint64_t> &used : m_Used) {
+    result += used.load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+void MemoryAccount::setName(const std::string &name) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Name = name;
+}
+
+std::string MemoryAccount::name() const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Name;
+}
+
+void MemoryAccount::visitAccounts(const std::function<void(const MemoryAccount&)> &func) const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (const MemoryAccount *account = m_First; account != nullptr; account = account->m_Next) {
+    func(*account);
+  }
+}
+
+void *CountingResource::do_allocate(size_t bytes, size_t alignment) {
+  void *result = m_Upstream->allocate(bytes, alignment);
+  m_Account.charge(m_Category, bytes);
+  return result;
+}
+
+void CountingResource::do_deallocate(void *ptr, size_t bytes, size_t alignment) {
+  m_Upstream->deallocate(ptr, bytes, alignment);
+  m_Account.credit(m_Category, bytes);
+}
+
+bool CountingResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+  return this == &other;
+}
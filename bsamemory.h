@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+
+/// subsystems native memory gets booked to
+enum class MemoryCategory {
+  // arrays of parsed indexes
+  INDEX,
+  // name pools of parsed indexes
+  NAMES,
+  // lookup structures built on demand
+  CACHES,
+  // buffers of reads and extractions in flight
+  BUFFERS,
+  // objects wrapped for js
+  WRAPPERS,
+  // asynchronous work queued or running
+  WORKERS
+};
+
+/**
+ * native memory held by one owner, e.g. an archive index, by category. Charges
+ * to an account are added to the process account as well, which also lists all
+ * other accounts
+ */
+class MemoryAccount {
+public:
+  static constexpr size_t NUM_CATEGORIES = 6;
+
+  /// totals of the whole process
+  static MemoryAccount &process();
+
+  MemoryAccount();
+  ~MemoryAccount();
+  MemoryAccount(const MemoryAccount&) = delete;
+  MemoryAccount &operator=(const MemoryAccount&) = delete;
+
+  void charge(MemoryCategory category, uint64_t size);
+  void credit(MemoryCategory category, uint64_t size);
+  /// move bytes already charged to a different category
+  void rebook(MemoryCategory from, MemoryCategory to, uint64_t size);
+
+  uint64_t used(MemoryCategory category) const;
+  uint64_t total() const;
+
+  /// label to report the account under, e.g. the archive file name
+  void setName(const std::string &name);
+  std::string name() const;
+
+  /// call func for every account but the process account. Accounts can't be destroyed meanwhile
+  void visitAccounts(const std::function<void(const MemoryAccount&)> &func) const;
+
+private:
+  explicit MemoryAccount(MemoryAccount *parent);
+
+private:
+  MemoryAccount *m_Parent;
+  std::atomic<uint64_t> m_Used[NUM_CATEGORIES];
+  mutable std::mutex m_Mutex;
+  std::string m_Name;
+  // only used by the process account
+  MemoryAccount *m_First{ nullptr };
+  MemoryAccount *m_Next{ nullptr };
+  MemoryAccount *m_Previous{ nullptr };
+};
+
+/**
+ * memory resource that forwards to another one and charges everything it
+ * allocates to an account, for use with arenas and pmr containers
+ */
+class CountingResource : public std::pmr::memory_resource {
+public:
+  CountingResource(MemoryAccount &account, MemoryCategory category,
+                   std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+    : m_Account(account), m_Category(category), m_Upstream(upstream) {}
+
+protected:
+  virtual void *do_allocate(size_t bytes, size_t alignment) override;
+  virtual void do_deallocate(void *ptr, size_t bytes, size_t alignment) override;
+  virtual bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+private:
+  MemoryAccount &m_Account;
+  MemoryCategory m_Category;
+  std::pmr::memory_resource *m_Upstream;
+};
+
+/**
+ * base for classes whose heap allocated instances are charged to the process
+ * account. The full size of derived classes is counted, as long as they are
+ * deleted through a virtual destructor
+ */
+template <MemoryCategory Category> class CountedObject {
+public:
+  static void *operator new(size_t size) {
+    void *result = ::operator new(size);
+    MemoryAccount::process().charge(Category, size);
+    return result;
+  }
+
+  static void operator delete(void *ptr, size_t size) {
+    MemoryAccount::process().credit(Category, size);
+    ::operator delete(ptr);
+  }
+};
@@ -0,0 +1,160 @@
+#include "bsametrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+
+// 32 exact buckets, then 16 per power of two
+const unsigned SUB_BITS = 5;
+const uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+const uint64_t HALF_BUCKETS = SUB_BUCKETS / 2;
+// about 18 minutes, longer operations land in the last bucket
+const unsigned MAX_BITS = 40;
+const uint64_t MAX_VALUE = (uint64_t(1) << MAX_BITS) - 1;
+const size_t NUM_BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BITS) * HALF_BUCKETS;
+
+size_t bucketIndex(uint64_t value) {
+  value = std::min(value, MAX_VALUE);
+  if (value < SUB_BUCKETS) {
+    return static_cast<size_t>(value);
+  }
+  unsigned shift = 1;
+  while ((value >> shift) >= SUB_BUCKETS) {
+    ++shift;
+  }
+  return static_cast<size_t>(SUB_BUCKETS + (shift - 1) * HALF_BUCKETS + ((value >> shift) - HALF_BUCKETS));
+}
+
+uint64_t bucketUpperBound(size_t bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  uint64_t shift = (bucket - SUB_BUCKETS) / HALF_BUCKETS + 1;
+  uint64_t mantissa = (bucket - SUB_BUCKETS) % HALF_BUCKETS + HALF_BUCKETS;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+}
+
+struct LatencyMetrics::Shard {
+  struct Counters {
+    std::atomic<uint64_t> buckets[NUM_BUCKETS];
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+  };
+  Counters operations[NUM_OPERATIONS];
+
+  Shard() {
+    for (Counters &counters : operations) {
+      for (std::atomic<uint64_t> &bucket : counters.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      counters.sum.store(0, std::memory_order_relaxed);
+      counters.max.store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+/// binds a shard to a thread, returns it to the pool when the thread exits
+struct LatencyMetrics::Lease {
+  Shard *shard{ nullptr };
+
+  ~Lease() {
+    if (shard != nullptr) {
+      LatencyMetrics::operations().releaseShard(shard);
+    }
+  }
+};
+
+LatencyMetrics::Timer::~Timer() {
+  LatencyMetrics::operations().record(m_Operation, std::chrono::steady_clock::now() - m_Start);
+}
+
+uint64_t LatencyMetrics::Histogram::percentile(double fraction) const {
+  if (m_Count == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(std::ceil(std::min(std::max(fraction, 0.0), 1.0) * m_Count));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < m_Buckets.size(); ++i) {
+    seen += m_Buckets[i];
+    if (seen >= rank) {
+      return std::min(bucketUpperBound(i), m_Max);
+    }
+  }
+  return m_Max;
+}
+
+LatencyMetrics &LatencyMetrics::operations() {
+  // never destroyed, threads may still record while the process exits
+  static LatencyMetrics *s_Metrics = new LatencyMetrics();
+  return *s_Metrics;
+}
+
+LatencyMetrics::Shard &LatencyMetrics::localShard() {
+  thread_local Lease t_Lease;
+  if (t_Lease.shard == nullptr) {
+    t_Lease.shard = acquireShard();
+  }
+  return *t_Lease.shard;
+}
+
+LatencyMetrics::Shard *LatencyMetrics::acquireShard() {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (!m_Free.empty()) {
+    Shard *result = m_Free.back();
+    m_Free.pop_back();
+    return result;
+  }
+  m_Shards.emplace_back(new Shard());
+  return m_Shards.back().get();
+}
+
+void LatencyMetrics::releaseShard(Shard *shard) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Free.push_back(shard);
+}
+
+void LatencyMetrics::record(Operation operation, std::chrono::steady_clock::duration duration) {
+  uint64_t value = static_cast<uint64_t>(std::max<int64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0));
+  // only the owning thread writes to the shard, the atomics are for readers
+  Shard::Counters &counters = localShard().operations[static_cast<size_t>(operation)];
+  counters.buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  counters.sum.fetch_add(value, std::memory_order_relaxed);
+  if (value > counters.max.load(std::memory_order_relaxed)) {
+    counters.max.store(value, std::memory_order_relaxed);
+  }
+}
+
+LatencyMetrics::Histogram LatencyMetrics::histogram(Operation operation) const {
+  Histogram result;
+  result.m_Buckets.resize(NUM_BUCKETS, 0);
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (const std::unique_ptr<Shard> &shard : m_Shards) {
+    const Shard::Counters &counters = shard->operations[static_cast<size_t>(operation)];
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+      uint64_t count = counters.buckets[i].load(std::memory_order_relaxed);
+      result.m_Buckets[i] += count;
+      result.m_Count += count;
+    }
+    result.m_Sum += counters.sum.load(std::memory_order_relaxed);
+    result.m_Max = std::max(result.m_Max, counters.max.load(std::memory_order_relaxed));
+  }
+  return result;
+}
+
+void LatencyMetrics::reset() {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (const std::unique_ptr<Shard> &shard : m_Shards) {
+    for (Shard::Counters &counters : shard->operations) {
+      for (std::atomic<uint64_t> &bucket : counters.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      counters.sum.store(0, std::memory_order_relaxed);
+      counters.max.store(0, std::memory_order_relaxed);
+    }
+  }
+}
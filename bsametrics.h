@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * latency histograms of the public operations. Every thread records into its own
+ * counters without locking, they are merged when read.
+ * Buckets are HDR-style, linear within each power of two, so every value is kept
+ * within 1/16 of its magnitude
+ */
+class LatencyMetrics {
+public:
+  enum class Operation {
+    LOAD,
+    NAVIGATE,
+    EXTRACT_FILE,
+    EXTRACT_ALL,
+    WRITE
+  };
+  static constexpr size_t NUM_OPERATIONS = 5;
+
+  /// merged counts of one operation, all values in nanoseconds
+  class Histogram {
+  public:
+    uint64_t count() const { return m_Count; }
+    uint64_t sum() const { return m_Sum; }
+    uint64_t max() const { return m_Max; }
+    double mean() const { return m_Count == 0 ? 0.0 : static_cast<double>(m_Sum) / m_Count; }
+
+    /// upper bound of the bucket below which fraction of the values lie
+    uint64_t percentile(double fraction) const;
+
+  private:
+    friend class LatencyMetrics;
+    std::vector<uint64_t> m_Buckets;
+    uint64_t m_Count{ 0 };
+    uint64_t m_Sum{ 0 };
+    uint64_t m_Max{ 0 };
+  };
+
+  /// records the time until it goes out of scope
+  class Timer {
+  public:
+    explicit Timer(Operation operation)
+      : m_Operation(operation), m_Start(std::chrono::steady_clock::now()) {}
+    ~Timer();
+    Timer(const Timer&) = delete;
+    Timer &operator=(const Timer&) = delete;
+
+  private:
+    Operation m_Operation;
+    std::chrono::steady_clock::time_point m_Start;
+  };
+
+public:
+  /// metrics of the whole process
+  static LatencyMetrics &operations();
+
+  LatencyMetrics(const LatencyMetrics&) = delete;
+  LatencyMetrics &operator=(const LatencyMetrics&) = delete;
+
+  void record(Operation operation, std::chrono::steady_clock::duration duration);
+  Histogram histogram(Operation operation) const;
+  /// clear all counters. Values recorded at the same time may survive the reset
+  void reset();
+
+private:
+  struct Shard;
+  struct Lease;
+
+  LatencyMetrics() = default;
+
+  /// counters of the calling thread
+  Shard &localShard();
+  Shard *acquireShard();
+  void releaseShard(Shard *shard);
+
+private:
+  mutable std::mutex m_Mutex;
+  // shards of exited threads keep their counts and are handed to new threads
+  std::vector<std::unique_ptr<Shard>> m_Shards;
+  std::vector<Shard*> m_Free;
+};
@@ -0,0 +1,92 @@
+#include "bsapath.h"
+
+// sse2 is part of every x86-64 cpu, no runtime check needed
+#if defined(__x86_64__) || defined(_M_X64)
+#define PATH_KERNEL_X86 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+char lowerChar(char ch) {
+  return ((ch >= 'A') && (ch <= 'Z')) ? static_cast<char>(ch - 'A' + 'a') : ch;
+}
+
+template <bool slashes> void transformScalar(char *data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    char ch = data[i];
+    data[i] = (slashes && (ch == '/')) ? '\\' : lowerChar(ch);
+  }
+}
+
+#ifdef PATH_KERNEL_X86
+
+// upper case letters are detected with a single signed compare: adding
+// 128 - 'A' moves 'A'..'Z' to the bottom of the signed range
+const char UPPER_SHIFT = static_cast<char>(128 - 'A');
+const char UPPER_LIMIT = static_cast<char>(-128 + 26);
+
+template <bool slashes> void transformSSE2(char *data, size_t size) {
+  const __m128i shift = _mm_set1_epi8(UPPER_SHIFT);
+  const __m128i limit = _mm_set1_epi8(UPPER_LIMIT);
+  const __m128i caseBit = _mm_set1_epi8(0x20);
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i backslash = _mm_set1_epi8('\\');
+
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i *ptr = reinterpret_cast<__m128i*>(data + i);
+    __m128i chars = _mm_loadu_si128(ptr);
+    __m128i upper = _mm_cmplt_epi8(_mm_add_epi8(chars, shift), limit);
+    chars = _mm_or_si128(chars, _mm_and_si128(upper, caseBit));
+    if (slashes) {
+      __m128i isSlash = _mm_cmpeq_epi8(chars, slash);
+      chars = _mm_or_si128(_mm_andnot_si128(isSlash, chars), _mm_and_si128(isSlash, backslash));
+    }
+    _mm_storeu_si128(ptr, chars);
+  }
+  transformScalar<slashes>(data + i, size - i);
+}
+
+#endif
+
+template <bool slashes> void transform(char *data, size_t size, PathKernel kernel) {
+#ifdef PATH_KERNEL_X86
+  switch (kernel) {
+    case PathKernel::SSE2: transformSSE2<slashes>(data, size); return;
+    default: break;
+  }
+#endif
+  transformScalar<slashes>(data, size);
+}
+
+}
+
+PathKernel bestPathKernel() {
+#ifdef PATH_KERNEL_X86
+  return PathKernel::SSE2;
+#else
+  return PathKernel::SCALAR;
+#endif
+}
+
+const char *pathKernelName(PathKernel kernel) {
+  switch (kernel) {
+    case PathKernel::SSE2: return "sse2";
+    default: return "scalar";
+  }
+}
+
+void canonicalizePath(char *data, size_t size, PathKernel kernel) {
+  transform<true>(data, size, kernel);
+}
+
+void lowerPath(char *data, size_t size, PathKernel kernel) {
+  transform<false>(data, size, kernel);
+}
+
+void normalizePath(std::string &path) {
+  canonicalizePath(&path[0], path.size());
+  size_t skip = path.find_first_not_of('\\');
+  path.erase(0, skip == std::string::npos ? path.size() : skip);
+}
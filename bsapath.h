@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * implementation of the path kernels, the best one the build supports is the
+ * default. Paths are too short for wider vectors to pay off
+ */
+enum class PathKernel {
+  SCALAR,
+  SSE2
+};
+
+/// best kernel supported by the build
+PathKernel bestPathKernel();
+
+/// human readable kernel name, for benchmarks
+const char *pathKernelName(PathKernel kernel);
+
+/**
+ * lower case ascii letters and turn forward slashes into backslashes, in place.
+ * Bytes outside of ascii are left alone
+ */
+void canonicalizePath(char *data, size_t size, PathKernel kernel = bestPathKernel());
+
+/// lower case ascii letters in place, separators are left alone
+void lowerPath(char *data, size_t size, PathKernel kernel = bestPathKernel());
+
+/**
+ * bring a path into the form used inside archives: lower case, backslashes as
+ * separators and no leading separator
+ */
+void normalizePath(std::string &path);
@@ -0,0 +1,743 @@
+#include "bsareader.h"
+#include "bsabudget.h"
+#include "bsamanifest.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/**
+ * writes the data of a record to disk. Compressed data gets inflated as it
+ * arrives so only one chunk of output is held in memory. Counts what it writes
+ * for the manifest
+ */
+class OutputFile {
+public:
+  OutputFile(const std::string &outputPath, bool compressed, size_t chunkSize, bool digest = false)
+    : m_Compressed(compressed)
+    , m_Digest(digest)
+  {
+    fs::path path = toNativePath(outputPath);
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+
+    m_File.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_File.is_open()) {
+      throw std::runtime_error("access failed");
+    }
+
+    if (m_Compressed) {
+      memset(&m_Stream, 0, sizeof(z_stream));
+      if (inflateInit(&m_Stream) != Z_OK) {
+        throw std::runtime_error("zlib init failed");
+      }
+      m_Chunk.resize(chunkSize);
+    }
+  }
+
+  ~OutputFile() {
+    if (m_Compressed) {
+      inflateEnd(&m_Stream);
+    }
+  }
+
+  /// pass the next piece of the record, past the embedded name
+  void write(const uint8_t *data, size_t size) {
+    if (!m_Compressed) {
+      put(data, size);
+      return;
+    }
+
+    // compressed data is preceded by the original size
+    while ((m_SizeFieldLength < sizeof(uint32_t)) && (size > 0)) {
+      m_OriginalSize |= static_cast<uint32_t>(*data++) << (8 * m_SizeFieldLength++);
+      --size;
+    }
+
+    m_Stream.next_in = const_cast<Bytef*>(data);
+    m_Stream.avail_in = static_cast<uInt>(size);
+    while (!m_Ended && ((m_Stream.avail_in > 0) || (m_Stream.avail_out == 0))) {
+      m_Stream.next_out = m_Chunk.data();
+      m_Stream.avail_out = static_cast<uInt>(m_Chunk.size());
+      int res = inflate(&m_Stream, Z_NO_FLUSH);
+      if (res == Z_STREAM_END) {
+        m_Ended = true;
+      } else if ((res != Z_OK) && ((res != Z_BUF_ERROR) || (m_Stream.avail_in > 0))) {
+        throw std::runtime_error("invalid data");
+      }
+      put(m_Chunk.data(), m_Chunk.size() - m_Stream.avail_out);
+      if (res == Z_BUF_ERROR) {
+        break;
+      }
+    }
+  }
+
+  uint64_t written() const { return m_Written; }
+  uint32_t crc32() const { return m_CRC; }
+
+  /// @throws std::runtime_error if the data was incomplete
+  void finish() {
+    if (m_Compressed
+        && ((m_SizeFieldLength < sizeof(uint32_t)) || !m_Ended || (m_Stream.total_out != m_OriginalSize))) {
+      throw std::runtime_error("invalid data");
+    }
+    if (!m_File.flush()) {
+      throw std::runtime_error("access failed");
+    }
+  }
+
+private:
+  void put(const uint8_t *data, size_t size) {
+    if (!m_File.write(reinterpret_cast<const char*>(data), size)) {
+      throw std::runtime_error("access failed");
+    }
+    m_Written += size;
+    if (m_Digest) {
+      m_CRC = ::crc32(m_CRC, data, static_cast<uInt>(size));
+    }
+  }
+
+private:
+  std::ofstream m_File;
+  bool m_Compressed;
+  z_stream m_Stream;
+  bool m_Ended{ false };
+  size_t m_SizeFieldLength{ 0 };
+  uint32_t m_OriginalSize{ 0 };
+  std::vector<uint8_t> m_Chunk;
+  bool m_Digest{ false };
+  uint64_t m_Written{ 0 };
+  uint32_t m_CRC{ 0 };
+};
+
+}
+
+/// batches get read in ascending offset order, each read carries its own buffer
+static void sortByOffset(std::vector<SourceRead> &reads) {
+  std::sort(reads.begin(), reads.end(), [](const SourceRead &lhs, const SourceRead &rhs) {
+    return lhs.offset < rhs.offset;
+  });
+}
+
+std::shared_ptr<ArchiveReader> ArchiveReader::open(const std::string &fileName, bool testHashes) {
+  std::shared_ptr<ArchiveReader> result(new ArchiveReader());
+  result->openFile(fileName);
+  result->parseIndex(testHashes);
+  return result;
+}
+
+std::shared_ptr<ArchiveReader> ArchiveReader::open(std::unique_ptr<ArchiveSource> source, bool testHashes) {
+  std::shared_ptr<ArchiveReader> result(new ArchiveReader());
+  result->m_Source = std::move(source);
+  result->parseIndex(testHashes);
+  return result;
+}
+
+std::shared_ptr<ArchiveReader> ArchiveReader::attach(const std::shared_ptr<const ArchiveIndex> &index,
+                                                     const std::string &fileName) {
+  std::shared_ptr<ArchiveReader> result(new ArchiveReader());
+  result->openFile(fileName);
+  result->m_Index = index;
+  return result;
+}
+
+void ArchiveReader::openFile(const std::string &fileName) {
+  m_FileName = fileName;
+  m_Source = makeFileArchiveSource(fileName);
+}
+
+void ArchiveReader::parseIndex(bool testHashes) {
+  // the index is parsed from one contiguous buffer, sources held in memory are
+  // parsed in place, others take two reads
+  if (m_Source->size() < ArchiveIndex::HEADER_SIZE) {
+    throw std::runtime_error("invalid data");
+  }
+  uint8_t header[ArchiveIndex::HEADER_SIZE];
+  m_Source->read(0, header, ArchiveIndex::HEADER_SIZE);
+  size_t size = ArchiveIndex::indexSize(header, ArchiveIndex::HEADER_SIZE);
+  if (size > m_Source->size()) {
+    throw std::runtime_error("invalid data");
+  }
+
+  std::vector<uint8_t> buffer;
+  const uint8_t *data = m_Source->map(0, size);
+  if (data == nullptr) {
+    buffer.resize(size);
+    m_Source->read(0, buffer.data(), size);
+    data = buffer.data();
+  }
+
+  std::shared_ptr<ArchiveIndex> index = std::make_shared<ArchiveIndex>();
+  index->memory().setName(m_FileName);
+  index->parse(data, size, testHashes);
+  m_Index = index;
+}
+
+ArchiveReader::SourceUse::SourceUse(ArchiveReader &reader)
+  : m_Reader(reader)
+{
+  std::lock_guard<std::mutex> lock(reader.m_UseMutex);
+  if (reader.m_Closed || !reader.m_Source || !reader.m_Source->isOpen()) {
+    throw std::runtime_error("access failed");
+  }
+  ++reader.m_Users;
+}
+
+ArchiveReader::SourceUse::~SourceUse() {
+  std::lock_guard<std::mutex> lock(m_Reader.m_UseMutex);
+  if ((--m_Reader.m_Users == 0) && m_Reader.m_Closed) {
+    m_Reader.m_Source->close();
+  }
+}
+
+bool ArchiveReader::isOpen() const {
+  std::lock_guard<std::mutex> lock(m_UseMutex);
+  return !m_Closed && m_Source && m_Source->isOpen();
+}
+
+void ArchiveReader::close() {
+  std::lock_guard<std::mutex> lock(m_UseMutex);
+  m_Closed = true;
+  if ((m_Users == 0) && m_Source) {
+    m_Source->close();
+  }
+}
+
+const uint8_t *ArchiveReader::fetch(uint32_t file, std::vector<uint8_t> &buffer) {
+  uint64_t offset = m_Index->fileOffset(file);
+  uint32_t size = m_Index->fileSize(file);
+  const uint8_t *record = m_Source->map(offset, size);
+  if (record == nullptr) {
+    buffer.resize(size);
+    if (size > 0) {
+      m_Source->read(offset, buffer.data(), size);
+    }
+    record = buffer.data();
+  }
+  return record;
+}
+
+const uint8_t *ArchiveReader::payload(uint32_t file, const uint8_t *record, uint32_t &size) const {
+  size = m_Index->fileSize(file);
+  if (m_Index->embeddedNames()) {
+    if ((size < 1) || (size < record[0] + 1U)) {
+      throw std::runtime_error("invalid data");
+    }
+    size -= record[0] + 1;
+    record += record[0] + 1;
+  }
+  return record;
+}
+
+void ArchiveReader::decode(uint32_t file, const uint8_t *record, std::vector<uint8_t> &output) const {
+  uint32_t size;
+  const uint8_t *data = payload(file, record, size);
+
+  const ArchiveIndex &index = *m_Index;
+  if (!index.fileCompressed(file)) {
+    output.assign(data, data + size);
+    return;
+  }
+
+  // skyrim se archives are lz4 compressed which isn't supported
+  if ((index.version() == ArchiveIndex::VERSION_SKYRIMSE) || (size < sizeof(uint32_t))) {
+    throw std::runtime_error("invalid data");
+  }
+
+  uint32_t originalSize = 0;
+  memcpy(&originalSize, data, sizeof(uint32_t));
+  output.resize(originalSize);
+  uLongf outputSize = originalSize;
+  int res = uncompress(output.data(), &outputSize, data + sizeof(uint32_t), size - sizeof(uint32_t));
+  if ((res != Z_OK) || (outputSize != originalSize)) {
+    throw std::runtime_error("invalid data");
+  }
+}
+
+void ArchiveReader::read(uint32_t file, std::vector<uint8_t> &output) {
+  SourceUse use(*this);
+  std::vector<uint8_t> buffer;
+  decode(file, fetch(file, buffer), output);
+}
+
+uint32_t ArchiveReader::expectedNameSize(uint32_t file) const {
+  if (!m_Index->embeddedNames()) {
+    return 0;
+  }
+  return static_cast<uint32_t>(1 + m_Index->folderPathView(m_Index->fileFolder(file)).size()
+                               + 1 + m_Index->fileNameView(file).size());
+}
+
+void ArchiveReader::readRange(uint32_t file, uint64_t offset, uint32_t length, std::vector<uint8_t> &output) {
+  RangeRead range{ file, offset, length, &output };
+  readRanges(&range, 1);
+}
+
+void ArchiveReader::readRanges(RangeRead *ranges, size_t count) {
+  SourceUse use(*this);
+
+  const ArchiveIndex &index = *m_Index;
+  bool embedded = index.embeddedNames();
+
+  // the head of a record is everything up to the end of the range, for compressed
+  // records plus some slack. Stored records without names are read directly
+  std::vector<SourceRead> reads;
+  std::vector<const uint8_t*> heads(count, nullptr);
+  std::vector<uint32_t> headSizes(count, 0);
+  std::vector<size_t> readIdx(count, SIZE_MAX);
+  uint64_t total = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const RangeRead &range = ranges[i];
+    if (range.file >= index.numFiles()) {
+      throw std::runtime_error("file not found");
+    }
+    uint32_t recordSize = index.fileSize(range.file);
+    uint64_t headOffset = index.fileOffset(range.file);
+    uint64_t headSize;
+    if (!embedded && !index.fileCompressed(range.file)) {
+      uint64_t start = std::min<uint64_t>(range.offset, recordSize);
+      headOffset += start;
+      headSize = std::min<uint64_t>(range.length, recordSize - start);
+    } else {
+      headSize = expectedNameSize(range.file) + range.offset + range.length;
+      if (index.fileCompressed(range.file)) {
+        headSize += sizeof(uint32_t) + INFLATE_SLACK;
+      }
+      headSize = std::min<uint64_t>(headSize, recordSize);
+    }
+
+    headSizes[i] = static_cast<uint32_t>(headSize);
+    heads[i] = m_Source->map(headOffset, headSizes[i]);
+    if (heads[i] == nullptr) {
+      readIdx[i] = reads.size();
+      reads.push_back({ headOffset, headSizes[i], nullptr });
+      total += headSize;
+    }
+  }
+
+  std::vector<uint8_t> buffer(total);
+  size_t bufferOffset = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (readIdx[i] != SIZE_MAX) {
+      reads[readIdx[i]].buffer = buffer.data() + bufferOffset;
+      heads[i] = buffer.data() + bufferOffset;
+      bufferOffset += headSizes[i];
+    }
+  }
+  if (!reads.empty()) {
+    sortByOffset(reads);
+    m_Source->readBatch(reads.data(), reads.size());
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    const RangeRead &range = ranges[i];
+    const uint8_t *head = heads[i];
+    uint32_t headSize = headSizes[i];
+    if (!embedded && !index.fileCompressed(range.file)) {
+      range.output->assign(head, head + headSize);
+      continue;
+    }
+
+    uint32_t dataStart = 0;
+    if (embedded) {
+      if ((headSize < 1) || (index.fileSize(range.file) < head[0] + 1U)) {
+        throw std::runtime_error("invalid data");
+      }
+      dataStart = head[0] + 1;
+    }
+
+    if (index.fileCompressed(range.file)) {
+      inflateRange(range, head, headSize, dataStart);
+      continue;
+    }
+
+    uint64_t dataSize = index.fileSize(range.file) - dataStart;
+    uint64_t start = std::min<uint64_t>(range.offset, dataSize);
+    uint64_t length = std::min<uint64_t>(range.length, dataSize - start);
+    if (dataStart + start + length <= headSize) {
+      range.output->assign(head + dataStart + start, head + dataStart + start + length);
+    } else {
+      // the embedded name wasn't the expected one
+      range.output->resize(length);
+      if (length > 0) {
+        m_Source->read(index.fileOffset(range.file) + dataStart + start, range.output->data(), length);
+      }
+    }
+  }
+}
+
+void ArchiveReader::inflateRange(const RangeRead &range, const uint8_t *head, size_t headSize,
+                                 uint32_t dataStart) {
+  const ArchiveIndex &index = *m_Index;
+  uint32_t recordSize = index.fileSize(range.file);
+  if ((index.version() == ArchiveIndex::VERSION_SKYRIMSE)
+      || (recordSize < dataStart + sizeof(uint32_t))) {
+    throw std::runtime_error("invalid data");
+  }
+
+  std::vector<uint8_t> chunk;
+  uint32_t consumed = dataStart + sizeof(uint32_t);
+  if (headSize < consumed) {
+    // a longer embedded name than expected
+    chunk.resize(std::min<uint32_t>(recordSize, consumed + INFLATE_SLACK));
+    m_Source->read(index.fileOffset(range.file), chunk.data(), chunk.size());
+    head = chunk.data();
+    headSize = chunk.size();
+  }
+
+  uint32_t originalSize = 0;
+  memcpy(&originalSize, head + dataStart, sizeof(uint32_t));
+  uint64_t start = std::min<uint64_t>(range.offset, originalSize);
+  uint64_t end = start + std::min<uint64_t>(range.length, originalSize - start);
+  range.output->resize(end - start);
+  if (end == start) {
+    return;
+  }
+
+  z_stream stream;
+  memset(&stream, 0, sizeof(z_stream));
+  if (inflateInit(&stream) != Z_OK) {
+    throw std::runtime_error("zlib init failed");
+  }
+
+  // data before the range gets inflated into a scratch buffer and dropped
+  std::vector<uint8_t> discard(static_cast<size_t>(std::min<uint64_t>(start, INFLATE_CHUNK)));
+  uint64_t produced = 0;
+  stream.next_in = const_cast<Bytef*>(head + consumed);
+  stream.avail_in = static_cast<uInt>(headSize - consumed);
+  consumed = static_cast<uint32_t>(headSize);
+
+  int res = Z_OK;
+  while (produced < end) {
+    if ((stream.avail_in == 0) && (consumed < recordSize)) {
+      chunk.resize(std::min<uint32_t>(INFLATE_CHUNK, recordSize - consumed));
+      m_Source->read(index.fileOffset(range.file) + consumed, chunk.data(), chunk.size());
+      stream.next_in = chunk.data();
+      stream.avail_in = static_cast<uInt>(chunk.size());
+      consumed += static_cast<uint32_t>(chunk.size());
+    }
+
+    uint64_t before = produced;
+    if (produced < start) {
+      stream.next_out = discard.data();
+      stream.avail_out = static_cast<uInt>(std::min<uint64_t>(discard.size(), start - produced));
+    } else {
+      stream.next_out = range.output->data() + (produced - start);
+      stream.avail_out = static_cast<uInt>(end - produced);
+    }
+    uInt outputSize = stream.avail_out;
+    res = inflate(&stream, Z_NO_FLUSH);
+    produced += outputSize - stream.avail_out;
+    if ((res == Z_STREAM_END) || ((res != Z_OK) && (res != Z_BUF_ERROR))
+        || ((produced == before) && (stream.avail_in == 0) && (consumed >= recordSize))) {
+      break;
+    }
+  }
+  inflateEnd(&stream);
+
+  if (produced < end) {
+    throw std::runtime_error("invalid data");
+  }
+}
+
+void ArchiveReader::writeRecord(uint32_t file, const uint8_t *record, const std::string &outputPath,
+                                ExtractionManifest *manifest) {
+  // skyrim se archives are lz4 compressed which isn't supported
+  bool compressed = m_Index->fileCompressed(file);
+  if (compressed && (m_Index->version() == ArchiveIndex::VERSION_SKYRIMSE)) {
+    throw std::runtime_error("invalid data");
+  }
+
+  uint32_t size;
+  const uint8_t *data = payload(file, record, size);
+  OutputFile output(outputPath, compressed, OUTPUT_CHUNK, (manifest != nullptr) && manifest->digests());
+  output.write(data, size);
+  output.finish();
+  if (manifest != nullptr) {
+    manifest->add(file, output.written(), output.crc32());
+  }
+}
+
+bool ArchiveReader::shouldStream(uint32_t file) {
+  uint32_t size = m_Index->fileSize(file);
+  return (size > STREAM_THRESHOLD) && (m_Source->map(m_Index->fileOffset(file), size) == nullptr);
+}
+
+void ArchiveReader::streamRecord(uint32_t file, const std::string &outputPath,
+                                 ExtractionManifest *manifest) {
+  const ArchiveIndex &index = *m_Index;
+  bool compressed = index.fileCompressed(file);
+  if (compressed && (index.version() == ArchiveIndex::VERSION_SKYRIMSE)) {
+    throw std::runtime_error("invalid data");
+  }
+
+  uint64_t offset = index.fileOffset(file);
+  uint32_t size = index.fileSize(file);
+  std::vector<uint8_t> chunk(STREAM_CHUNK);
+  OutputFile output(outputPath, compressed, OUTPUT_CHUNK, (manifest != nullptr) && manifest->digests());
+  for (uint32_t position = 0; position < size; ) {
+    uint32_t length = std::min(STREAM_CHUNK, size - position);
+    m_Source->read(offset + position, chunk.data(), length);
+    uint32_t skip = 0;
+    if ((position == 0) && index.embeddedNames()) {
+      skip = chunk[0] + 1U;
+      if (skip > length) {
+        throw std::runtime_error("invalid data");
+      }
+    }
+    output.write(chunk.data() + skip, length - skip);
+    position += length;
+  }
+  output.finish();
+  if (manifest != nullptr) {
+    manifest->add(file, output.written(), output.crc32());
+  }
+}
+
+void ArchiveReader::extract(uint32_t file, const std::string &outputDirectory) {
+  SourceUse use(*this);
+
+  std::string outputPath = outputDirectory + "\\" + m_Index->fileName(file);
+  MemoryBudget &budget = MemoryBudget::extraction();
+  if (shouldStream(file)) {
+    MemoryBudget::Lease lease = budget.acquire(STREAM_CHUNK + OUTPUT_CHUNK);
+    streamRecord(file, outputPath);
+  } else {
+    uint64_t offset = m_Index->fileOffset(file);
+    uint32_t size = m_Index->fileSize(file);
+    bool mapped = m_Source->map(offset, size) != nullptr;
+    MemoryBudget::Lease lease = budget.acquire((mapped ? 0 : size) + OUTPUT_CHUNK);
+    std::vector<uint8_t> buffer;
+    writeRecord(file, fetch(file, buffer), outputPath);
+  }
+}
+
+std::vector<uint32_t> ArchiveReader::scheduleFiles(IOSchedule schedule) const {
+  const ArchiveIndex &index = *m_Index;
+  std::vector<uint32_t> order(index.numFiles());
+  for (uint32_t i = 0; i < index.numFiles(); ++i) {
+    order[i] = i;
+  }
+
+  if (schedule == IOSchedule::AUTO) {
+    schedule = m_Source->seekPenalty() ? IOSchedule::OFFSET : IOSchedule::OUTPUT_PATH;
+  }
+  if (schedule == IOSchedule::OFFSET) {
+    std::stable_sort(order.begin(), order.end(), [&index](uint32_t lhs, uint32_t rhs) {
+      return index.fileOffset(lhs) < index.fileOffset(rhs);
+    });
+  } else {
+    std::stable_sort(order.begin(), order.end(), [&index](uint32_t lhs, uint32_t rhs) {
+      int res = index.folderPathView(index.fileFolder(lhs)).compare(index.folderPathView(index.fileFolder(rhs)));
+      return (res < 0) || ((res == 0) && (index.fileNameView(lhs) < index.fileNameView(rhs)));
+    });
+  }
+  return order;
+}
+
+void ArchiveReader::adviseRecords(const uint32_t *files, size_t count) {
+  const ArchiveIndex &index = *m_Index;
+  size_t i = 0;
+  while (i < count) {
+    uint64_t offset = index.fileOffset(files[i]);
+    uint64_t end = offset + index.fileSize(files[i]);
+    for (++i; (i < count) && (index.fileOffset(files[i]) == end); ++i) {
+      end += index.fileSize(files[i]);
+    }
+    m_Source->advise(AccessHint::WILL_NEED, offset, end - offset);
+  }
+}
+
+void ArchiveReader::extractAll(const std::string &outputDirectory,
+                               const std::function<bool(int, std::string)> &progress,
+                               IOSchedule schedule, ExtractionManifest *manifest) {
+  Extraction extraction(*this, outputDirectory, schedule);
+  extraction.setManifest(manifest);
+  while (extraction.step(progress)) {
+  }
+}
+
+ArchiveReader::Extraction::Extraction(ArchiveReader &reader, const std::string &outputDirectory,
+                                      IOSchedule schedule)
+  : m_Reader(reader)
+  , m_OutputDirectory(outputDirectory)
+{
+  SourceUse use(reader);
+  m_Order = reader.scheduleFiles(schedule);
+  reader.m_Source->advise(AccessHint::SEQUENTIAL, 0, reader.m_Source->size());
+  for (uint32_t file : m_Order) {
+    m_TotalSize += reader.m_Index->fileSize(file);
+  }
+}
+
+ArchiveReader::Extraction::Extraction(ArchiveReader &reader, FileConsumer consumer, IOSchedule schedule)
+  : Extraction(reader, std::string(), schedule)
+{
+  m_Consumer = std::move(consumer);
+}
+
+void ArchiveReader::Extraction::restrict(const std::vector<uint32_t> &files) {
+  const ArchiveIndex &index = *m_Reader.m_Index;
+  std::vector<bool> selected(index.numFiles(), false);
+  for (uint32_t file : files) {
+    if (file < selected.size()) {
+      selected[file] = true;
+    }
+  }
+  m_Order.erase(std::remove_if(m_Order.begin(), m_Order.end(),
+                               [&selected](uint32_t file) { return !selected[file]; }),
+                m_Order.end());
+  m_TotalSize = 0;
+  for (uint32_t file : m_Order) {
+    m_TotalSize += index.fileSize(file);
+  }
+}
+
+bool ArchiveReader::Extraction::claimBatch(uint32_t &first, uint32_t &last) {
+  const ArchiveIndex &index = *m_Reader.m_Index;
+  ArchiveSource &source = *m_Reader.m_Source;
+  uint32_t count = static_cast<uint32_t>(m_Order.size());
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  first = m_Next;
+  if (first >= count) {
+    return false;
+  }
+  // large records go on their own, records that aren't held in memory get read
+  // as one batch so sources with expensive reads see few, large requests
+  last = first + 1;
+  if (!m_Reader.shouldStream(m_Order[first])) {
+    uint64_t batchSize = 0;
+    if (source.map(index.fileOffset(m_Order[first]), index.fileSize(m_Order[first])) == nullptr) {
+      batchSize = index.fileSize(m_Order[first]);
+    }
+    while ((last < count)
+           && (last - first < MAX_BATCH_FILES)
+           && !m_Reader.shouldStream(m_Order[last])) {
+      uint32_t file = m_Order[last];
+      uint64_t size = (source.map(index.fileOffset(file), index.fileSize(file)) == nullptr)
+        ? index.fileSize(file) : 0;
+      if (batchSize + size > MAX_BATCH_SIZE) {
+        break;
+      }
+      batchSize += size;
+      ++last;
+    }
+  }
+  for (uint32_t i = first; i < last; ++i) {
+    m_ClaimedSize += index.fileSize(m_Order[i]);
+  }
+  m_Next = last;
+  return true;
+}
+
+bool ArchiveReader::Extraction::remaining() {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Next < m_Order.size();
+}
+
+uint64_t ArchiveReader::Extraction::remainingSize() {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_TotalSize - m_ClaimedSize;
+}
+
+void ArchiveReader::Extraction::completed(uint32_t file) {
+  m_ExtractedSize.fetch_add(m_Reader.m_Index->fileSize(file), std::memory_order_relaxed);
+  m_Extracted.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ArchiveReader::Extraction::output(uint32_t file, const uint8_t *record) {
+  if (m_Consumer) {
+    std::vector<uint8_t> data;
+    m_Reader.decode(file, record, data);
+    // not waited for, the step already holds a lease and blocking here while
+    // holding it could deadlock
+    MemoryBudget::Lease lease = MemoryBudget::extraction().charge(data.size());
+    if (m_Manifest != nullptr) {
+      m_Manifest->add(file, data.size(),
+                      m_Manifest->digests() ? ::crc32(0, data.data(), static_cast<uInt>(data.size())) : 0);
+    }
+    m_Consumer(file, data, lease);
+  } else {
+    m_Reader.writeRecord(file, record, m_OutputDirectory + "\\" + m_Reader.m_Index->filePath(file), m_Manifest);
+  }
+}
+
+bool ArchiveReader::Extraction::step(const std::function<bool(int, std::string)> &progress) {
+  // the archive may get closed between steps
+  SourceUse use(m_Reader);
+  const ArchiveIndex &index = *m_Reader.m_Index;
+  ArchiveSource &source = *m_Reader.m_Source;
+  MemoryBudget &budget = MemoryBudget::extraction();
+  const std::vector<uint32_t> &order = m_Order;
+  uint32_t count = static_cast<uint32_t>(order.size());
+  uint32_t first;
+  uint32_t last;
+  if (!claimBatch(first, last)) {
+    return false;
+  }
+
+  if (m_Reader.shouldStream(order[first])) {
+    uint32_t file = order[first];
+    std::string filePath = index.filePath(file);
+    if (!progress(static_cast<int>((first * 100ULL) / count), filePath)) {
+      throw std::runtime_error("canceled");
+    }
+    if (m_Consumer) {
+      MemoryBudget::Lease lease = budget.acquire(index.fileSize(file) + OUTPUT_CHUNK);
+      std::vector<uint8_t> buffer;
+      output(file, m_Reader.fetch(file, buffer));
+    } else {
+      MemoryBudget::Lease lease = budget.acquire(STREAM_CHUNK + OUTPUT_CHUNK);
+      m_Reader.streamRecord(file, m_OutputDirectory + "\\" + filePath, m_Manifest);
+    }
+    completed(file);
+    return remaining();
+  }
+
+  std::vector<const uint8_t*> records;
+  std::vector<SourceRead> reads;
+  uint64_t batchSize = 0;
+  for (uint32_t i = first; i < last; ++i) {
+    uint32_t file = order[i];
+    const uint8_t *record = source.map(index.fileOffset(file), index.fileSize(file));
+    if (record == nullptr) {
+      reads.push_back({ index.fileOffset(file), index.fileSize(file), nullptr });
+      batchSize += index.fileSize(file);
+    }
+    records.push_back(record);
+  }
+
+  MemoryBudget::Lease lease = budget.acquire(batchSize + OUTPUT_CHUNK);
+  std::vector<uint8_t> buffer(batchSize);
+  size_t bufferOffset = 0;
+  size_t readIdx = 0;
+  for (const uint8_t *&record : records) {
+    if (record == nullptr) {
+      reads[readIdx].buffer = buffer.data() + bufferOffset;
+      record = reads[readIdx].buffer;
+      bufferOffset += reads[readIdx].length;
+      ++readIdx;
+    }
+  }
+  if (!reads.empty()) {
+    // the source can read ahead while this batch gets decompressed and written
+    m_Reader.adviseRecords(order.data() + last, std::min<size_t>(MAX_BATCH_FILES, count - last));
+    sortByOffset(reads);
+    source.readBatch(reads.data(), reads.size());
+  }
+
+  for (uint32_t i = first; i < last; ++i) {
+    if (!progress(static_cast<int>((i * 100ULL) / count), index.filePath(order[i]))) {
+      throw std::runtime_error("canceled");
+    }
+    output(order[i], records[i - first]);
+    completed(order[i]);
+  }
+  return remaining();
+}
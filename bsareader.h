@@ -0,0 +1,239 @@
+#pragma once
+
+#include "bsabudget.h"
+#include "bsaindex.h"
+#include "bsamanifest.h"
+#include "bsasource.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// part of a file to read with ArchiveReader::readRanges
+struct RangeRead {
+  uint32_t file;
+  uint64_t offset;
+  uint32_t length;
+  /// receives the data, shorter than length if the file ends before
+  std::vector<uint8_t> *output;
+};
+
+/// order in which files get extracted
+enum class IOSchedule {
+  /// offset order if the source has a seek penalty, output path order otherwise
+  AUTO,
+  /// ascending data offset, the archive gets read front to back
+  OFFSET,
+  /// sorted by output path, files in a directory get written together
+  OUTPUT_PATH
+};
+
+/**
+ * read access to a bsa on disk or in memory, backed by an ArchiveIndex.
+ * Reads and extractions may run on any number of threads at once, the source is
+ * only ever accessed through positional reads
+ */
+class ArchiveReader {
+public:
+  /**
+   * receives the decoded content of a file during an extraction and may take it
+   * over. lease books the content against MemoryBudget::extraction, a consumer
+   * that holds on to the content takes the lease as well. Called on the threads
+   * running the steps
+   */
+  typedef std::function<void(uint32_t file, std::vector<uint8_t> &data,
+                             MemoryBudget::Lease &lease)> FileConsumer;
+
+  /**
+   * extractAll in steps of one batch of files, so a scheduler can interleave the
+   * extraction with other work. The reader has to outlive the extraction.
+   * Steps may run on several threads at once, each one takes the next batch
+   */
+  class Extraction {
+  public:
+    /// @throws std::runtime_error
+    Extraction(ArchiveReader &reader, const std::string &outputDirectory, IOSchedule schedule);
+
+    /**
+     * decode the files into memory and hand them to consumer instead of writing
+     * them to disk. Records too large to be read as a whole are still decoded in one piece
+     * @throws std::runtime_error
+     */
+    Extraction(ArchiveReader &reader, FileConsumer consumer, IOSchedule schedule);
+
+    /**
+     * extract the next batch of files, returns false once no files are left to
+     * start on. Progress is reported as with extractAll
+     */
+    bool step(const std::function<bool(int, std::string)> &progress);
+
+    /// record every file produced in the manifest. Call before the first step
+    void setManifest(ExtractionManifest *manifest) { m_Manifest = manifest; }
+
+    /// only extract these files, in the scheduled order. Call before the first step
+    void restrict(const std::vector<uint32_t> &files);
+
+    uint32_t numFiles() const { return static_cast<uint32_t>(m_Order.size()); }
+    /// size of all records to extract, as stored in the archive
+    uint64_t totalSize() const { return m_TotalSize; }
+    /// size of the records no step has started on yet
+    uint64_t remainingSize();
+
+    /// files completed so far. Thread-safe
+    uint32_t extracted() const { return m_Extracted.load(std::memory_order_relaxed); }
+    /// size of the records completed so far. Thread-safe
+    uint64_t extractedSize() const { return m_ExtractedSize.load(std::memory_order_relaxed); }
+
+  private:
+    /// reserve the next files to extract, false if there are none left
+    bool claimBatch(uint32_t &first, uint32_t &last);
+    bool remaining();
+    void output(uint32_t file, const uint8_t *record);
+    void completed(uint32_t file);
+
+  private:
+    ArchiveReader &m_Reader;
+    std::string m_OutputDirectory;
+    FileConsumer m_Consumer;
+    ExtractionManifest *m_Manifest{ nullptr };
+    std::vector<uint32_t> m_Order;
+    uint64_t m_TotalSize{ 0 };
+    std::mutex m_Mutex;
+    uint32_t m_Next{ 0 };
+    uint64_t m_ClaimedSize{ 0 };
+    std::atomic<uint32_t> m_Extracted{ 0 };
+    std::atomic<uint64_t> m_ExtractedSize{ 0 };
+  };
+
+public:
+  /**
+   * open the archive and parse its index
+   * @param fileName utf-8 encoded path
+   * @throws std::runtime_error
+   */
+  static std::shared_ptr<ArchiveReader> open(const std::string &fileName, bool testHashes);
+
+  /**
+   * parse the index of an archive from any source. The reader has no file name
+   * so its index can't be attached to from elsewhere
+   * @throws std::runtime_error
+   */
+  static std::shared_ptr<ArchiveReader> open(std::unique_ptr<ArchiveSource> source, bool testHashes);
+
+  /**
+   * open the archive using an index that was already parsed, for example by
+   * another thread
+   * @throws std::runtime_error
+   */
+  static std::shared_ptr<ArchiveReader> attach(const std::shared_ptr<const ArchiveIndex> &index,
+                                               const std::string &fileName);
+
+  ArchiveReader(const ArchiveReader&) = delete;
+  ArchiveReader &operator=(const ArchiveReader&) = delete;
+
+  const std::shared_ptr<const ArchiveIndex> &index() const { return m_Index; }
+  const std::string &fileName() const { return m_FileName; }
+
+  bool isOpen() const;
+  /// operations already running finish first, the source gets closed after the last one
+  void close();
+
+  /**
+   * read the content of a file, decompressed if necessary
+   */
+  void read(uint32_t file, std::vector<uint8_t> &output);
+
+  /**
+   * read part of a file without reading or decompressing all of it. Compressed
+   * files are only inflated up to the end of the range
+   */
+  void readRange(uint32_t file, uint64_t offset, uint32_t length, std::vector<uint8_t> &output);
+
+  /**
+   * read parts of many files. The start of every record is fetched in a single
+   * batch, further reads are only needed if the compressed data turns out to be
+   * larger than the range
+   */
+  void readRanges(RangeRead *ranges, size_t count);
+
+  /**
+   * extract a single file into the output directory, without its folder path.
+   * Extraction buffers count against MemoryBudget::extraction, this blocks until
+   * the budget allows them
+   */
+  void extract(uint32_t file, const std::string &outputDirectory);
+
+  /**
+   * extract all files into the output directory, recreating the folder structure.
+   * progress gets called with the percentage and the file about to be extracted,
+   * returning false cancels the operation. The files written are recorded in
+   * manifest if one is passed
+   */
+  void extractAll(const std::string &outputDirectory,
+                  const std::function<bool(int, std::string)> &progress,
+                  IOSchedule schedule = IOSchedule::AUTO,
+                  ExtractionManifest *manifest = nullptr);
+
+private:
+  /// marks an operation using the source, close is deferred until all are done
+  class SourceUse {
+  public:
+    /// @throws std::runtime_error if the reader is closed
+    explicit SourceUse(ArchiveReader &reader);
+    ~SourceUse();
+    SourceUse(const SourceUse&) = delete;
+    SourceUse &operator=(const SourceUse&) = delete;
+
+  private:
+    ArchiveReader &m_Reader;
+  };
+
+private:
+  ArchiveReader() = default;
+
+  void openFile(const std::string &fileName);
+  void parseIndex(bool testHashes);
+  /// raw record of a file, in place for memory backed sources, otherwise read into buffer
+  const uint8_t *fetch(uint32_t file, std::vector<uint8_t> &buffer);
+  /// file data within a raw record, past the embedded name
+  const uint8_t *payload(uint32_t file, const uint8_t *record, uint32_t &size) const;
+  void decode(uint32_t file, const uint8_t *record, std::vector<uint8_t> &output) const;
+  void writeRecord(uint32_t file, const uint8_t *record, const std::string &outputPath,
+                   ExtractionManifest *manifest = nullptr);
+  /// write a file read from the source in chunks instead of as one record
+  void streamRecord(uint32_t file, const std::string &outputPath,
+                    ExtractionManifest *manifest = nullptr);
+  /// large records that would have to be read into memory get streamed instead
+  bool shouldStream(uint32_t file);
+  /// size of the embedded name record if it holds the full path as usual
+  uint32_t expectedNameSize(uint32_t file) const;
+  void inflateRange(const RangeRead &range, const uint8_t *head, size_t headSize, uint32_t dataStart);
+  std::vector<uint32_t> scheduleFiles(IOSchedule schedule) const;
+  /// hint the source about the records that get read next, adjacent ones merged
+  void adviseRecords(const uint32_t *files, size_t count);
+
+private:
+  // extractAll reads records in batches of up to this many files or bytes
+  static constexpr uint32_t MAX_BATCH_FILES = 64;
+  static constexpr uint64_t MAX_BATCH_SIZE = 4 * 1024 * 1024;
+  // extra compressed bytes fetched along with the range, covers deflate overhead
+  static constexpr uint32_t INFLATE_SLACK = 1024;
+  static constexpr uint32_t INFLATE_CHUNK = 64 * 1024;
+  // records larger than this are streamed, in chunks of STREAM_CHUNK
+  static constexpr uint32_t STREAM_THRESHOLD = 16 * 1024 * 1024;
+  static constexpr uint32_t STREAM_CHUNK = 1024 * 1024;
+  // output buffer for inflating compressed records during extraction
+  static constexpr uint32_t OUTPUT_CHUNK = 256 * 1024;
+
+private:
+  std::shared_ptr<const ArchiveIndex> m_Index;
+  std::string m_FileName;
+  std::unique_ptr<ArchiveSource> m_Source;
+
+  mutable std::mutex m_UseMutex;
+  unsigned m_Users{ 0 };
+  bool m_Closed{ false };
+};
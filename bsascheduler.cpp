@@ -0,0 +1,147 @@
+#include "bsascheduler.h"
+#include <algorithm>
+
+WorkScheduler::WorkScheduler(unsigned cpuWorkers, unsigned ioWorkers) {
+  setWorkers(Pool::CPU, cpuWorkers);
+  setWorkers(Pool::IO, ioWorkers);
+}
+
+WorkScheduler::~WorkScheduler() {
+  shutdown();
+}
+
+void WorkScheduler::setWorkers(Pool poolId, unsigned count) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (m_Stopping) {
+    return;
+  }
+  PoolState &state = pool(poolId);
+  state.target = std::max(count, 1U);
+  spawn(state);
+  // threads beyond the target exit once idle
+  m_Changed.notify_all();
+}
+
+unsigned WorkScheduler::workers(Pool poolId) const {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Pools[static_cast<int>(poolId)].target;
+}
+
+void WorkScheduler::submit(Pool poolId, Priority priority, const void *key, Task task) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (m_Stopping) {
+    return;
+  }
+  Queue &queue = pool(poolId).queues[static_cast<int>(priority)];
+  std::deque<Task> &tasks = queue.tasks[key];
+  if (tasks.empty()) {
+    queue.ready.push_back(key);
+  }
+  tasks.push_back(std::move(task));
+  m_Changed.notify_all();
+}
+
+void WorkScheduler::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stopping = true;
+    m_Changed.notify_all();
+  }
+  for (PoolState &state : m_Pools) {
+    for (std::thread &thread : state.threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+    state.threads.clear();
+    for (Queue &queue : state.queues) {
+      queue.tasks.clear();
+      queue.ready.clear();
+    }
+  }
+}
+
+void WorkScheduler::spawn(PoolState &state) {
+  if (state.threads.size() < state.target) {
+    state.threads.resize(state.target);
+    state.alive.resize(state.target, false);
+  }
+  for (unsigned i = 0; i < state.target; ++i) {
+    // a thread that exited after an earlier shrink gets replaced, one that is
+    // still winding down simply keeps going
+    if (!state.alive[i]) {
+      if (state.threads[i].joinable()) {
+        state.threads[i].join();
+      }
+      state.alive[i] = true;
+      state.threads[i] = std::thread(&WorkScheduler::work, this, std::ref(state), i);
+    }
+  }
+}
+
+WorkScheduler::Queue *WorkScheduler::nextQueue(PoolState &state) {
+  for (int priority = 0; priority < NUM_PRIORITIES; ++priority) {
+    Queue &queue = state.queues[priority];
+    if (queue.ready.empty()) {
+      continue;
+    }
+    if ((priority == static_cast<int>(Priority::BACKGROUND))
+        && (state.target > 1)
+        && (state.runningBackground + 1 >= state.target)) {
+      break;
+    }
+    return &queue;
+  }
+  // steal interactive work from the other pool rather than idle
+  for (PoolState &other : m_Pools) {
+    Queue &queue = other.queues[static_cast<int>(Priority::INTERACTIVE)];
+    if ((&other != &state) && !queue.ready.empty()) {
+      return &queue;
+    }
+  }
+  return nullptr;
+}
+
+void WorkScheduler::work(PoolState &state, unsigned index) {
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while (true) {
+    Queue *queue = nullptr;
+    m_Changed.wait(lock, [this, &state, index, &queue]() {
+      if (m_Stopping || (index >= state.target)) {
+        return true;
+      }
+      queue = nextQueue(state);
+      return queue != nullptr;
+    });
+    if (m_Stopping || (index >= state.target)) {
+      state.alive[index] = false;
+      return;
+    }
+
+    const void *key = queue->ready.front();
+    queue->ready.pop_front();
+    auto iter = queue->tasks.find(key);
+    Task task = std::move(iter->second.front());
+    iter->second.pop_front();
+    if (iter->second.empty()) {
+      queue->tasks.erase(iter);
+    } else {
+      queue->ready.push_back(key);
+    }
+
+    bool background = queue == &state.queues[static_cast<int>(Priority::BACKGROUND)];
+    if (background) {
+      ++state.runningBackground;
+    }
+
+    lock.unlock();
+    task();
+    lock.lock();
+
+    if (background) {
+      --state.runningBackground;
+      // a worker held back from background work may take over
+      m_Changed.notify_all();
+    }
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * runs archive work on threads of its own instead of the libuv thread pool, which
+ * node shares with fs and dns.
+ * Work is queued per key, usually the archive it's for, and workers serve the keys
+ * in turn so an archive with lots of queued work doesn't hold up the others.
+ * There are separate pools for cpu heavy work like parsing and compression and for
+ * io heavy work like extraction.
+ * Work of a higher priority is always served first. Interactive work is also taken
+ * by idle workers of the other pool so it doesn't wait behind bulk work, and
+ * background work leaves one worker of each pool free for the other priorities.
+ */
+class WorkScheduler {
+public:
+  enum class Pool {
+    CPU,
+    IO
+  };
+
+  /// in the order they get served
+  enum class Priority {
+    INTERACTIVE,
+    NORMAL,
+    BACKGROUND
+  };
+
+  typedef std::function<void()> Task;
+
+public:
+  WorkScheduler(unsigned cpuWorkers, unsigned ioWorkers);
+  ~WorkScheduler();
+  WorkScheduler(const WorkScheduler&) = delete;
+  WorkScheduler &operator=(const WorkScheduler&) = delete;
+
+  /// change the number of threads of a pool, at least one is kept
+  void setWorkers(Pool pool, unsigned count);
+  unsigned workers(Pool pool) const;
+
+  /**
+   * queue a task. Tasks with the same key and priority run in the order they were
+   * submitted, tasks with different keys take turns
+   */
+  void submit(Pool pool, Priority priority, const void *key, Task task);
+
+  /// stop all threads once their current task is done, queued tasks are dropped
+  void shutdown();
+
+private:
+  static constexpr int NUM_PRIORITIES = 3;
+
+  struct Queue {
+    std::unordered_map<const void*, std::deque<Task>> tasks;
+    // keys with queued tasks, in the order they get served
+    std::deque<const void*> ready;
+  };
+
+  struct PoolState {
+    Queue queues[NUM_PRIORITIES];
+    std::vector<std::thread> threads;
+    std::vector<bool> alive;
+    unsigned target{ 0 };
+    unsigned runningBackground{ 0 };
+  };
+
+private:
+  PoolState &pool(Pool pool) { return m_Pools[static_cast<int>(pool)]; }
+  /// start threads up to the target count. Call with the mutex locked
+  void spawn(PoolState &state);
+  /// queue the next task of a worker of the pool comes from, if any
+  Queue *nextQueue(PoolState &state);
+  void work(PoolState &state, unsigned index);
+
+private:
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_Changed;
+  bool m_Stopping{ false };
+  PoolState m_Pools[2];
+};
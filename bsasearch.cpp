@@ -0,0 +1,157 @@
+#include "bsasearch.h"
+#include "bsaindex.h"
+#include "bsapath.h"
+#include <algorithm>
+#include <numeric>
+#include <string_view>
+
+namespace {
+
+char lowerChar(char ch) {
+  return ((ch >= 'A') && (ch <= 'Z')) ? static_cast<char>(ch - 'A' + 'a') : ch;
+}
+
+// full path of a file as stored in the index, without assembling a string
+struct PathRef {
+  std::string_view folder;
+  std::string_view name;
+
+  PathRef(const ArchiveIndex &index, uint32_t file)
+    : folder(index.folderPathView(index.fileFolder(file)))
+    , name(index.fileNameView(file))
+  {}
+
+  size_t size() const { return folder.empty() ? name.size() : folder.size() + 1 + name.size(); }
+
+  char at(size_t pos) const {
+    if (folder.empty()) {
+      return lowerChar(name[pos]);
+    }
+    if (pos < folder.size()) {
+      return lowerChar(folder[pos]);
+    }
+    return pos == folder.size() ? '\\' : lowerChar(name[pos - folder.size() - 1]);
+  }
+
+  char reverseAt(size_t pos) const { return at(size() - pos - 1); }
+};
+
+template <bool reversed> char charAt(const PathRef &path, size_t pos) {
+  return reversed ? path.reverseAt(pos) : path.at(pos);
+}
+
+template <bool reversed> bool pathLess(const PathRef &lhs, const PathRef &rhs) {
+  size_t lhsSize = lhs.size();
+  size_t rhsSize = rhs.size();
+  size_t length = std::min(lhsSize, rhsSize);
+  for (size_t i = 0; i < length; ++i) {
+    char lhsChar = charAt<reversed>(lhs, i);
+    char rhsChar = charAt<reversed>(rhs, i);
+    if (lhsChar != rhsChar) {
+      return static_cast<unsigned char>(lhsChar) < static_cast<unsigned char>(rhsChar);
+    }
+  }
+  return lhsSize < rhsSize;
+}
+
+// compares only the first query.size() characters of path, so all paths that start
+// with the query compare equal
+template <bool reversed> int comparePrefix(const PathRef &path, const std::string &query) {
+  size_t pathSize = path.size();
+  size_t length = std::min(pathSize, query.size());
+  for (size_t i = 0; i < length; ++i) {
+    unsigned char pathChar = static_cast<unsigned char>(charAt<reversed>(path, i));
+    unsigned char queryChar = static_cast<unsigned char>(query[i]);
+    if (pathChar != queryChar) {
+      return pathChar < queryChar ? -1 : 1;
+    }
+  }
+  return pathSize < query.size() ? -1 : 0;
+}
+
+template <bool reversed>
+std::pair<size_t, size_t> matchRange(const ArchiveIndex &index,
+                                     const std::pmr::vector<uint32_t> &sorted,
+                                     const std::string &query) {
+  auto begin = std::partition_point(sorted.begin(), sorted.end(), [&](uint32_t file) {
+    return comparePrefix<reversed>(PathRef(index, file), query) < 0;
+  });
+  auto end = std::partition_point(begin, sorted.end(), [&](uint32_t file) {
+    return comparePrefix<reversed>(PathRef(index, file), query) == 0;
+  });
+  return { begin - sorted.begin(), end - sorted.begin() };
+}
+
+}
+
+PathIndex::PathIndex(const ArchiveIndex &index, std::pmr::memory_resource *resource)
+  : m_Index(index)
+  , m_ByPath(resource)
+  , m_ByReversedPath(resource)
+{
+  m_ByPath.resize(index.numFiles());
+  std::iota(m_ByPath.begin(), m_ByPath.end(), 0);
+  m_ByReversedPath = m_ByPath;
+
+  std::sort(m_ByPath.begin(), m_ByPath.end(), [&index](uint32_t lhs, uint32_t rhs) {
+    return pathLess<false>(PathRef(index, lhs), PathRef(index, rhs));
+  });
+  std::sort(m_ByReversedPath.begin(), m_ByReversedPath.end(), [&index](uint32_t lhs, uint32_t rhs) {
+    return pathLess<true>(PathRef(index, lhs), PathRef(index, rhs));
+  });
+}
+
+SearchPage PathIndex::search(SearchMode mode, const std::string &query,
+                             uint32_t cursor, uint32_t limit) const {
+  std::string normalized(query);
+  normalizePath(normalized);
+
+  switch (mode) {
+    case SearchMode::PREFIX: return searchRange(m_ByPath, false, normalized, cursor, limit);
+    case SearchMode::SUFFIX: {
+      std::reverse(normalized.begin(), normalized.end());
+      return searchRange(m_ByReversedPath, true, normalized, cursor, limit);
+    }
+    default: return searchContains(normalized, cursor, limit);
+  }
+}
+
+SearchPage PathIndex::searchRange(const std::pmr::vector<uint32_t> &sorted, bool reversed,
+                                  const std::string &query, uint32_t cursor, uint32_t limit) const {
+  std::pair<size_t, size_t> range = reversed
+    ? matchRange<true>(m_Index, sorted, query)
+    : matchRange<false>(m_Index, sorted, query);
+
+  SearchPage result;
+  result.total = static_cast<uint32_t>(range.second - range.first);
+  size_t begin = std::min<size_t>(range.first + cursor, range.second);
+  size_t end = std::min<size_t>(begin + limit, range.second);
+  result.files.assign(sorted.begin() + begin, sorted.begin() + end);
+  if (end < range.second) {
+    result.next = static_cast<uint32_t>(end - range.first);
+  }
+  return result;
+}
+
+SearchPage PathIndex::searchContains(const std::string &query, uint32_t cursor, uint32_t limit) const {
+  SearchPage result;
+  uint32_t numFiles = m_Index.numFiles();
+  std::string path;
+  for (uint32_t file = cursor; file < numFiles; ++file) {
+    if (result.files.size() == limit) {
+      result.next = file;
+      break;
+    }
+    PathRef ref(m_Index, file);
+    if (ref.folder.empty()) {
+      path.assign(ref.name);
+    } else {
+      path.assign(ref.folder).append(1, '\\').append(ref.name);
+    }
+    lowerPath(&path[0], path.size());
+    if (path.find(query) != std::string::npos) {
+      result.files.push_back(file);
+    }
+  }
+  return result;
+}
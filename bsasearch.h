@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+class ArchiveIndex;
+
+enum class SearchMode {
+  PREFIX,
+  SUFFIX,
+  CONTAINS
+};
+
+struct SearchPage {
+  static constexpr uint32_t END = UINT32_MAX;
+
+  std::vector<uint32_t> files;
+  /// cursor to pass in to get the next page, END if there are no further results
+  uint32_t next{ END };
+  /// total number of matches, only known for prefix and suffix searches
+  uint32_t total{ END };
+};
+
+/**
+ * file lookup by full path. Keeps the file ids of an archive sorted by path and
+ * by reversed path so prefix and suffix queries are a binary search for the
+ * range of matching entries, substring queries scan the name pool.
+ * Paths are compared case-insensitive with backslashes as separators.
+ * The sorted arrays are allocated from the resource passed in.
+ */
+class PathIndex {
+public:
+  PathIndex(const ArchiveIndex &index, std::pmr::memory_resource *resource);
+
+  /**
+   * find files matching the query
+   * @param cursor 0 for the first page, otherwise the "next" value of the previous page.
+   *               That is an offset into the matches for prefix and suffix queries
+   *               and the file to resume at for substring queries
+   * @param limit maximum number of files to return
+   */
+  SearchPage search(SearchMode mode, const std::string &query, uint32_t cursor, uint32_t limit) const;
+
+private:
+  SearchPage searchRange(const std::pmr::vector<uint32_t> &sorted, bool reversed,
+                         const std::string &query, uint32_t cursor, uint32_t limit) const;
+  SearchPage searchContains(const std::string &query, uint32_t cursor, uint32_t limit) const;
+
+private:
+  const ArchiveIndex &m_Index;
+  std::pmr::vector<uint32_t> m_ByPath;
+  std::pmr::vector<uint32_t> m_ByReversedPath;
+};
@@ -0,0 +1,212 @@
+#include "bsashared.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::mutex s_Mutex;
+std::unordered_map<uint32_t, IndexRegistry::Entry> s_Entries;
+std::unordered_map<std::string, std::unique_ptr<SharedSegment>> s_Published;
+uint32_t s_NextHandle = 1;
+
+// layout of a published segment: header, archive file name, serialized index
+struct SegmentHeader {
+  std::atomic<uint32_t> magic;
+  uint32_t fileNameLength;
+  uint64_t indexOffset;
+  uint64_t indexSize;
+};
+
+const uint32_t SEGMENT_MAGIC = 0x53415342; // "BSAS"
+
+#ifdef _WIN32
+std::wstring toWide(const std::string &input) {
+  int length = MultiByteToWideChar(CP_UTF8, 0, input.c_str(), static_cast<int>(input.size()), nullptr, 0);
+  std::wstring result(length, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, input.c_str(), static_cast<int>(input.size()), &result[0], length);
+  return result;
+}
+#else
+std::string posixName(const std::string &name) {
+  return name[0] == '/' ? name : "/" + name;
+}
+#endif
+
+}
+
+std::unique_ptr<SharedSegment> SharedSegment::create(const std::string &name, size_t size) {
+  std::unique_ptr<SharedSegment> result(new SharedSegment());
+#ifdef _WIN32
+  HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                      static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                      static_cast<DWORD>(size & 0xFFFFFFFF),
+                                      toWide(name).c_str());
+  if ((mapping == nullptr) || (GetLastError() == ERROR_ALREADY_EXISTS)) {
+    if (mapping != nullptr) {
+      CloseHandle(mapping);
+    }
+    throw std::runtime_error("access failed");
+  }
+  result->m_Handle = mapping;
+  result->m_Data = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size));
+#else
+  std::string shmName = posixName(name);
+  int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd == -1) {
+    throw std::runtime_error("access failed");
+  }
+  result->m_UnlinkName = shmName;
+  if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    result->m_Data = data == MAP_FAILED ? nullptr : static_cast<uint8_t*>(data);
+  }
+  ::close(fd);
+#endif
+  if (result->m_Data == nullptr) {
+    throw std::runtime_error("access failed");
+  }
+  result->m_Size = size;
+  return result;
+}
+
+std::unique_ptr<SharedSegment> SharedSegment::open(const std::string &name) {
+  std::unique_ptr<SharedSegment> result(new SharedSegment());
+#ifdef _WIN32
+  HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, toWide(name).c_str());
+  if (mapping == nullptr) {
+    throw std::runtime_error("file not found");
+  }
+  result->m_Handle = mapping;
+  result->m_Data = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  MEMORY_BASIC_INFORMATION info;
+  if ((result->m_Data != nullptr) && (VirtualQuery(result->m_Data, &info, sizeof(info)) != 0)) {
+    result->m_Size = info.RegionSize;
+  }
+#else
+  int fd = shm_open(posixName(name).c_str(), O_RDONLY, 0);
+  if (fd == -1) {
+    throw std::runtime_error("file not found");
+  }
+  struct stat info;
+  if ((fstat(fd, &info) == 0) && (info.st_size > 0)) {
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED) {
+      result->m_Data = static_cast<uint8_t*>(data);
+      result->m_Size = info.st_size;
+    }
+  }
+  ::close(fd);
+#endif
+  if (result->m_Data == nullptr) {
+    throw std::runtime_error("access failed");
+  }
+  return result;
+}
+
+SharedSegment::~SharedSegment() {
+#ifdef _WIN32
+  if (m_Data != nullptr) {
+    UnmapViewOfFile(m_Data);
+  }
+  if (m_Handle != nullptr) {
+    CloseHandle(m_Handle);
+  }
+#else
+  if (m_Data != nullptr) {
+    munmap(m_Data, m_Size);
+  }
+  if (!m_UnlinkName.empty()) {
+    shm_unlink(m_UnlinkName.c_str());
+  }
+#endif
+}
+
+uint32_t IndexRegistry::publish(const std::shared_ptr<const ArchiveIndex> &index,
+                                const std::string &fileName) {
+  std::lock_guard<std::mutex> lock(s_Mutex);
+  uint32_t handle = s_NextHandle++;
+  s_Entries[handle] = { index, fileName };
+  return handle;
+}
+
+IndexRegistry::Entry IndexRegistry::lookup(uint32_t handle) {
+  std::lock_guard<std::mutex> lock(s_Mutex);
+  auto iter = s_Entries.find(handle);
+  if (iter == s_Entries.end()) {
+    throw std::runtime_error("invalid index handle");
+  }
+  return iter->second;
+}
+
+void IndexRegistry::release(uint32_t handle) {
+  std::lock_guard<std::mutex> lock(s_Mutex);
+  s_Entries.erase(handle);
+}
+
+void IndexRegistry::publishShared(const std::string &name, const ArchiveIndex &index,
+                                  const std::string &fileName) {
+  if (name.empty()) {
+    throw std::runtime_error("invalid name");
+  }
+
+  // the other process may run in a different working directory
+  std::string absolutePath = std::filesystem::absolute(std::filesystem::u8path(fileName)).u8string();
+
+  size_t indexOffset = (sizeof(SegmentHeader) + absolutePath.size() + 7) & ~static_cast<size_t>(7);
+  size_t indexSize = index.serializedSize();
+  std::unique_ptr<SharedSegment> segment = SharedSegment::create(name, indexOffset + indexSize);
+
+  uint8_t *data = segment->data();
+  SegmentHeader *header = new (data) SegmentHeader();
+  header->fileNameLength = static_cast<uint32_t>(absolutePath.size());
+  header->indexOffset = indexOffset;
+  header->indexSize = indexSize;
+  memcpy(data + sizeof(SegmentHeader), absolutePath.c_str(), absolutePath.size());
+  index.serialize(data + indexOffset);
+  // readers check the magic before anything else so it gets written last
+  header->magic.store(SEGMENT_MAGIC, std::memory_order_release);
+
+  std::lock_guard<std::mutex> lock(s_Mutex);
+  s_Published[name] = std::move(segment);
+}
+
+void IndexRegistry::unpublishShared(const std::string &name) {
+  std::lock_guard<std::mutex> lock(s_Mutex);
+  s_Published.erase(name);
+}
+
+IndexRegistry::Entry IndexRegistry::attachShared(const std::string &name) {
+  std::shared_ptr<SharedSegment> segment = SharedSegment::open(name);
+  const uint8_t *data = segment->data();
+  const SegmentHeader *header = reinterpret_cast<const SegmentHeader*>(data);
+  if ((segment->size() < sizeof(SegmentHeader))
+      || (header->magic.load(std::memory_order_acquire) != SEGMENT_MAGIC)
+      || (sizeof(SegmentHeader) + header->fileNameLength > segment->size())
+      || (header->indexOffset > segment->size())
+      || (header->indexSize > segment->size() - header->indexOffset)) {
+    throw std::runtime_error("invalid data");
+  }
+
+  Entry result;
+  result.fileName.assign(reinterpret_cast<const char*>(data + sizeof(SegmentHeader)),
+                         header->fileNameLength);
+  std::shared_ptr<ArchiveIndex> index = std::make_shared<ArchiveIndex>();
+  index->memory().setName(result.fileName);
+  index->deserialize(data + header->indexOffset, header->indexSize, segment);
+  result.index = index;
+  return result;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "bsaindex.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * named shared memory segment, a file mapping on windows and a posix shared
+ * memory object elsewhere
+ */
+class SharedSegment {
+public:
+  /// @throws std::runtime_error
+  static std::unique_ptr<SharedSegment> create(const std::string &name, size_t size);
+  /// map an existing segment read-only. @throws std::runtime_error
+  static std::unique_ptr<SharedSegment> open(const std::string &name);
+
+  ~SharedSegment();
+  SharedSegment(const SharedSegment&) = delete;
+  SharedSegment &operator=(const SharedSegment&) = delete;
+
+  uint8_t *data() const { return m_Data; }
+  size_t size() const { return m_Size; }
+
+private:
+  SharedSegment() = default;
+
+private:
+  uint8_t *m_Data{ nullptr };
+  size_t m_Size{ 0 };
+  void *m_Handle{ nullptr };
+  // the creator of a posix segment removes its name again
+  std::string m_UnlinkName;
+};
+
+/**
+ * process-wide registry of exported archive indexes. The addon is loaded once per
+ * process so all worker threads see the same registry, a handle exported on one
+ * thread can be attached to from any other one. Indexes are immutable after
+ * parsing so any number of threads can read them concurrently.
+ * An exported index stays alive until its handle is released, even if the
+ * exporting archive is closed in the meantime.
+ */
+class IndexRegistry {
+public:
+  struct Entry {
+    std::shared_ptr<const ArchiveIndex> index;
+    std::string fileName;
+  };
+
+public:
+  static uint32_t publish(const std::shared_ptr<const ArchiveIndex> &index, const std::string &fileName);
+  /// @throws std::runtime_error if the handle is unknown
+  static Entry lookup(uint32_t handle);
+  static void release(uint32_t handle);
+
+  /**
+   * copy an index into a named shared memory segment so other processes can open
+   * it with attachShared. The segment exists until it gets unpublished or this
+   * process ends
+   */
+  static void publishShared(const std::string &name, const ArchiveIndex &index,
+                            const std::string &fileName);
+  static void unpublishShared(const std::string &name);
+  /**
+   * map an index published by another process. The index is used in place,
+   * read-only
+   */
+  static Entry attachShared(const std::string &name);
+};
@@ -0,0 +1,339 @@
+#include "bsasource.h"
+#include "bsahandles.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+#endif
+
+namespace fs = std::filesystem;
+
+fs::path toNativePath(const std::string &utf8Path) {
+  std::string normalized(utf8Path);
+  for (char &ch : normalized) {
+    if (ch == '\\') {
+      ch = '/';
+    }
+  }
+  return fs::u8path(normalized);
+}
+
+namespace {
+
+#ifdef _WIN32
+
+bool querySeekPenalty(const fs::path &path) {
+  wchar_t volume[MAX_PATH];
+  if (!GetVolumePathNameW(path.wstring().c_str(), volume, MAX_PATH)) {
+    return true;
+  }
+  // the volume path is "C:\", the device is opened as "\\.\C:"
+  std::wstring device = L"\\\\.\\" + std::wstring(volume);
+  if (device.back() == L'\\') {
+    device.pop_back();
+  }
+  HANDLE handle = CreateFileW(device.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr, OPEN_EXISTING, 0, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return true;
+  }
+
+  STORAGE_PROPERTY_QUERY query{};
+  query.PropertyId = StorageDeviceSeekPenaltyProperty;
+  query.QueryType = PropertyStandardQuery;
+  DEVICE_SEEK_PENALTY_DESCRIPTOR result{};
+  DWORD size = 0;
+  BOOL success = DeviceIoControl(handle, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query),
+                                 &result, sizeof(result), &size, nullptr);
+  CloseHandle(handle);
+  return !success || (size < sizeof(result)) || result.IncursSeekPenalty;
+}
+
+#else
+
+bool querySeekPenalty(int fd) {
+#ifdef __linux__
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    return true;
+  }
+  // partitions don't have a queue of their own, theirs is on the parent device
+  std::string device = "/sys/dev/block/" + std::to_string(major(info.st_dev)) + ":"
+                     + std::to_string(minor(info.st_dev));
+  for (const char *queue : { "/queue/rotational", "/../queue/rotational" }) {
+    std::ifstream rotational(device + queue);
+    int value;
+    if (rotational >> value) {
+      return value != 0;
+    }
+  }
+#endif
+  // unknown devices, like network shares or device mapper volumes, get treated
+  // as spinning disks. Reading those in order costs little
+  return true;
+}
+
+#endif
+
+/**
+ * archive file read with positional reads. The handle is managed by
+ * HandlePool::archives(), if it got closed while idle it's reopened on the next
+ * read, provided the file is still the same
+ */
+class FileArchiveSource : public ArchiveSource, private HandlePool::Client {
+public:
+  explicit FileArchiveSource(const std::string &fileName)
+    : m_Path(toNativePath(fileName))
+  {
+    if (!openHandle()) {
+      closeHandle();
+      throw std::runtime_error("file not found");
+    }
+    m_Size = m_Identity.size;
+#ifdef _WIN32
+    m_SeekPenalty = querySeekPenalty(m_Path);
+#else
+    m_SeekPenalty = querySeekPenalty(m_Handle);
+#endif
+    HandlePool::archives().add(this);
+  }
+
+  ~FileArchiveSource() {
+    close();
+  }
+
+  virtual uint64_t size() const override { return m_Size; }
+
+  virtual void read(uint64_t offset, uint8_t *buffer, size_t length) override {
+    if (!isOpen()) {
+      throw std::runtime_error("access failed");
+    }
+    if (offset + length > m_Size) {
+      throw std::runtime_error("invalid data");
+    }
+    HandlePool::Pin pin(HandlePool::archives(), this);
+    Handle handle = activeHandle();
+#ifdef _WIN32
+    while (length > 0) {
+      // positional read, the shared file pointer isn't used so reads from several
+      // threads don't interfere
+      OVERLAPPED position{};
+      position.Offset = static_cast<DWORD>(offset);
+      position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+      DWORD chunk = static_cast<DWORD>(std::min<size_t>(length, 0x40000000));
+      DWORD count = 0;
+      if (!ReadFile(handle, buffer, chunk, &count, &position) || (count == 0)) {
+        throw std::runtime_error("invalid data");
+      }
+      buffer += count;
+      offset += count;
+      length -= count;
+    }
+#else
+    while (length > 0) {
+      ssize_t count = pread(handle, buffer, length, static_cast<off_t>(offset));
+      if ((count == -1) && (errno == EINTR)) {
+        continue;
+      }
+      if (count <= 0) {
+        throw std::runtime_error("invalid data");
+      }
+      buffer += count;
+      offset += count;
+      length -= count;
+    }
+#endif
+  }
+
+  virtual bool seekPenalty() const override { return m_SeekPenalty; }
+
+  virtual void advise(AccessHint hint, uint64_t offset, uint64_t length) override {
+#ifdef POSIX_FADV_WILLNEED
+    if (isOpen()) {
+      // only a hint, a handle that was closed isn't reopened for it
+      HandlePool::Pin pin(HandlePool::archives(), this);
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      if (m_Handle != INVALID_HANDLE) {
+        posix_fadvise(m_Handle, static_cast<off_t>(offset), static_cast<off_t>(length),
+                      hint == AccessHint::SEQUENTIAL ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_WILLNEED);
+      }
+    }
+#endif
+    // windows detects sequential access on its own
+  }
+
+  virtual bool isOpen() const override { return !m_Closed; }
+
+  virtual void close() override {
+    if (!m_Closed) {
+      m_Closed = true;
+      HandlePool::archives().remove(this);
+      closeHandle();
+    }
+  }
+
+private:
+#ifdef _WIN32
+  typedef HANDLE Handle;
+  static inline const Handle INVALID_HANDLE = INVALID_HANDLE_VALUE;
+#else
+  typedef int Handle;
+  static inline const Handle INVALID_HANDLE = -1;
+#endif
+
+  /// tells whether the file at the path is still the one that was opened first
+  struct Identity {
+    uint64_t device;
+    uint64_t file;
+    uint64_t modified;
+    uint64_t size;
+
+    bool operator==(const Identity &other) const {
+      return (device == other.device) && (file == other.file)
+          && (modified == other.modified) && (size == other.size);
+    }
+  };
+
+private:
+  /// open the file and read its identity, false on failure
+  bool openHandle() {
+#ifdef _WIN32
+    m_Handle = CreateFileW(m_Path.wstring().c_str(), GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    BY_HANDLE_FILE_INFORMATION info;
+    if ((m_Handle == INVALID_HANDLE_VALUE) || !GetFileInformationByHandle(m_Handle, &info)) {
+      return false;
+    }
+    m_Identity.device = info.dwVolumeSerialNumber;
+    m_Identity.file = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    m_Identity.modified = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32)
+                        | info.ftLastWriteTime.dwLowDateTime;
+    m_Identity.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+#else
+    m_Handle = ::open(m_Path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if ((m_Handle == -1) || (fstat(m_Handle, &info) != 0)) {
+      return false;
+    }
+    m_Identity.device = static_cast<uint64_t>(info.st_dev);
+    m_Identity.file = static_cast<uint64_t>(info.st_ino);
+    // full resolution, a rewrite within the same second still changes it
+#ifdef __APPLE__
+    const struct timespec &modified = info.st_mtimespec;
+#else
+    const struct timespec &modified = info.st_mtim;
+#endif
+    m_Identity.modified = static_cast<uint64_t>(modified.tv_sec) * 1000000000ULL
+                        + static_cast<uint64_t>(modified.tv_nsec);
+    m_Identity.size = static_cast<uint64_t>(info.st_size);
+#endif
+    return true;
+  }
+
+  void closeHandle() {
+    if (m_Handle != INVALID_HANDLE) {
+#ifdef _WIN32
+      CloseHandle(m_Handle);
+#else
+      ::close(m_Handle);
+#endif
+      m_Handle = INVALID_HANDLE;
+    }
+  }
+
+  /// handle to read from, reopened if it was evicted. Call with the source pinned
+  Handle activeHandle() {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      if (m_Handle != INVALID_HANDLE) {
+        return m_Handle;
+      }
+      Identity expected = m_Identity;
+      if (!openHandle() || !(m_Identity == expected)) {
+        // the archive got replaced or modified, offsets in the index can't be trusted
+        closeHandle();
+        m_Identity = expected;
+        throw std::runtime_error("archive changed on disk");
+      }
+    }
+    HandlePool::archives().reopened(this);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Handle;
+  }
+
+  virtual void evict() override {
+    closeHandle();
+  }
+
+private:
+  fs::path m_Path;
+  Handle m_Handle{ INVALID_HANDLE };
+  Identity m_Identity{};
+  std::mutex m_Mutex;
+  std::atomic<bool> m_Closed{ false };
+  uint64_t m_Size{ 0 };
+  bool m_SeekPenalty{ true };
+};
+
+class MemoryArchiveSource : public ArchiveSource {
+public:
+  MemoryArchiveSource(const uint8_t *data, size_t size, std::shared_ptr<const void> owner)
+    : m_Data(data), m_Size(size), m_Owner(std::move(owner))
+  {}
+
+  virtual uint64_t size() const override { return m_Size; }
+
+  virtual void read(uint64_t offset, uint8_t *buffer, size_t length) override {
+    memcpy(buffer, map(offset, length), length);
+  }
+
+  virtual const uint8_t *map(uint64_t offset, size_t length) override {
+    if (m_Data == nullptr) {
+      throw std::runtime_error("access failed");
+    }
+    if ((offset > m_Size) || (length > m_Size - offset)) {
+      throw std::runtime_error("invalid data");
+    }
+    return m_Data + offset;
+  }
+
+  virtual bool seekPenalty() const override { return false; }
+
+  virtual bool isOpen() const override { return m_Data != nullptr; }
+
+  virtual void close() override {
+    m_Data = nullptr;
+    m_Owner.reset();
+  }
+
+private:
+  const uint8_t *m_Data;
+  size_t m_Size;
+  std::shared_ptr<const void> m_Owner;
+};
+
+}
+
+std::unique_ptr<ArchiveSource> makeFileArchiveSource(const std::string &fileName) {
+  return std::unique_ptr<ArchiveSource>(new FileArchiveSource(fileName));
+}
+
+std::unique_ptr<ArchiveSource> makeMemoryArchiveSource(const uint8_t *data, size_t size,
+                                                       std::shared_ptr<const void> owner) {
+  return std::unique_ptr<ArchiveSource>(new MemoryArchiveSource(data, size, std::move(owner)));
+}
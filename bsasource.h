@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+/// one range of a batched read
+struct SourceRead {
+  uint64_t offset;
+  size_t length;
+  uint8_t *buffer;
+};
+
+/// how a range of the source is going to be accessed
+enum class AccessHint {
+  SEQUENTIAL,
+  WILL_NEED
+};
+
+/**
+ * random access to the raw bytes of an archive. Implement this to read archives
+ * stored inside other containers.
+ * read, readBatch and map get called from several threads at once, close only
+ * once no read is in flight
+ */
+class ArchiveSource {
+public:
+  virtual ~ArchiveSource() {}
+
+  /// total size of the archive in bytes
+  virtual uint64_t size() const = 0;
+
+  /**
+   * read exactly length bytes starting at offset
+   * @throws std::runtime_error if the range can't be read
+   */
+  virtual void read(uint64_t offset, uint8_t *buffer, size_t length) = 0;
+
+  /**
+   * read several ranges at once. Sources with a high cost per call should override
+   * this, by default the ranges are read one by one
+   * @throws std::runtime_error if any of the ranges can't be read
+   */
+  virtual void readBatch(const SourceRead *reads, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      read(reads[i].offset, reads[i].buffer, reads[i].length);
+    }
+  }
+
+  /**
+   * direct pointer to the range if the source is held in memory, nullptr otherwise.
+   * The pointer stays valid as long as the source is open
+   */
+  virtual const uint8_t *map(uint64_t offset, size_t length) { return nullptr; }
+
+  /**
+   * false if reading out of order costs no more than reading sequentially, like
+   * for solid state drives or memory. Unless the source knows otherwise it
+   * assumes spinning disks
+   */
+  virtual bool seekPenalty() const { return true; }
+
+  /// tell the source what will be read next, sources may ignore this
+  virtual void advise(AccessHint hint, uint64_t offset, uint64_t length) {}
+
+  virtual bool isOpen() const = 0;
+  virtual void close() = 0;
+};
+
+/// utf-8 path with either kind of separator to a native path
+std::filesystem::path toNativePath(const std::string &utf8Path);
+
+/// @throws std::runtime_error if the file can't be opened
+std::unique_ptr<ArchiveSource> makeFileArchiveSource(const std::string &fileName);
+
+/**
+ * archive held in memory. The data isn't copied, owner (if set) is kept alive
+ * together with the source, otherwise the caller has to guarantee the data stays
+ * valid for the lifetime of the source
+ */
+std::unique_ptr<ArchiveSource> makeMemoryArchiveSource(const uint8_t *data, size_t size,
+                                                       std::shared_ptr<const void> owner = nullptr);
@@ -0,0 +1,134 @@
+#include "bsatexture.h"
+#include "bsapath.h"
+#include "bsareader.h"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace {
+
+// headers are read in batches of this many files
+const size_t SCAN_BATCH = 256;
+
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t FOURCC_DX10 = 0x30315844; // "DX10"
+
+uint32_t readUInt32(const uint8_t *data, size_t offset) {
+  uint32_t result;
+  memcpy(&result, data + offset, sizeof(uint32_t));
+  return result;
+}
+
+bool isTexture(std::string_view name) {
+  static const char EXTENSION[] = ".dds";
+  const size_t length = sizeof(EXTENSION) - 1;
+  if (name.size() < length) {
+    return false;
+  }
+  char extension[length];
+  memcpy(extension, name.data() + name.size() - length, length);
+  lowerPath(extension, length);
+  return memcmp(extension, EXTENSION, length) == 0;
+}
+
+void scanArchive(uint32_t archive, ArchiveReader &reader, std::vector<TextureHeader> &result) {
+  const ArchiveIndex &index = *reader.index();
+
+  std::vector<uint32_t> textures;
+  for (uint32_t file = 0; file < index.numFiles(); ++file) {
+    if (isTexture(index.fileNameView(file))) {
+      textures.push_back(file);
+    }
+  }
+
+  std::vector<std::vector<uint8_t>> outputs(std::min(SCAN_BATCH, textures.size()));
+  std::vector<RangeRead> ranges;
+  for (size_t begin = 0; begin < textures.size(); begin += SCAN_BATCH) {
+    size_t end = std::min(begin + SCAN_BATCH, textures.size());
+    ranges.clear();
+    for (size_t i = begin; i < end; ++i) {
+      ranges.push_back({ textures[i], 0, DDS_HEADER_SIZE, &outputs[i - begin] });
+    }
+    try {
+      reader.readRanges(ranges.data(), ranges.size());
+    }
+    catch (const std::exception&) {
+      // one record that can't be decoded fails the whole batch, the others are
+      // read on their own so only that file goes without a header
+      for (RangeRead &range : ranges) {
+        try {
+          reader.readRanges(&range, 1);
+        }
+        catch (const std::exception&) {
+          range.output->clear();
+        }
+      }
+    }
+
+    for (size_t i = begin; i < end; ++i) {
+      const std::vector<uint8_t> &data = outputs[i - begin];
+      TextureHeader header{};
+      if (!parseDDSHeader(data.data(), data.size(), header)) {
+        header = TextureHeader{};
+      }
+      header.archive = archive;
+      header.file = textures[i];
+      result.push_back(header);
+    }
+  }
+}
+
+}
+
+bool parseDDSHeader(const uint8_t *data, size_t size, TextureHeader &header) {
+  // magic and the fixed size DDS_HEADER
+  if ((size < 128) || (memcmp(data, "DDS ", 4) != 0) || (readUInt32(data, 4) != 124)) {
+    return false;
+  }
+
+  header.height = readUInt32(data, 12);
+  header.width = readUInt32(data, 16);
+  header.mipCount = std::max<uint32_t>(readUInt32(data, 28), 1);
+  header.fourCC = (readUInt32(data, 80) & DDPF_FOURCC) != 0 ? readUInt32(data, 84) : 0;
+  header.dxgiFormat = 0;
+  if (header.fourCC == FOURCC_DX10) {
+    if (size < DDS_HEADER_SIZE) {
+      return false;
+    }
+    header.dxgiFormat = readUInt32(data, 128);
+  }
+  return true;
+}
+
+TextureScan::TextureScan(std::vector<std::shared_ptr<ArchiveReader>> archives)
+  : m_Archives(std::move(archives))
+  , m_First(m_Archives.size())
+  , m_Headers(m_Archives.size())
+{
+  for (size_t i = 0; i < m_Archives.size(); ++i) {
+    m_First[i] = std::find(m_Archives.begin(), m_Archives.begin() + i, m_Archives[i]) - m_Archives.begin();
+  }
+}
+
+bool TextureScan::step() {
+  size_t i = m_Next++;
+  while ((i < m_Archives.size()) && (m_First[i] != i)) {
+    i = m_Next++;
+  }
+  if (i >= m_Archives.size()) {
+    return false;
+  }
+  scanArchive(static_cast<uint32_t>(i), *m_Archives[i], m_Headers[i]);
+  return true;
+}
+
+std::vector<TextureHeader> TextureScan::result() const {
+  std::vector<TextureHeader> result;
+  for (size_t i = 0; i < m_Archives.size(); ++i) {
+    for (TextureHeader header : m_Headers[m_First[i]]) {
+      header.archive = static_cast<uint32_t>(i);
+      result.push_back(header);
+    }
+  }
+  return result;
+}
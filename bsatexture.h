@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ArchiveReader;
+
+/**
+ * header fields of a dds texture
+ */
+struct TextureHeader {
+  /// position of the archive in the scanned list
+  uint32_t archive;
+  uint32_t file;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mipCount;
+  /// 0 for uncompressed formats
+  uint32_t fourCC;
+  /// only set if fourCC is DX10
+  uint32_t dxgiFormat;
+};
+
+/**
+ * bytes needed to decode a dds header: magic, DDS_HEADER and DDS_HEADER_DXT10
+ */
+static constexpr uint32_t DDS_HEADER_SIZE = 148;
+
+/**
+ * decode the header at the start of a dds file
+ * @return false if the data isn't a dds header
+ */
+bool parseDDSHeader(const uint8_t *data, size_t size, TextureHeader &header);
+
+/**
+ * scan of the dds headers of all .dds files in a list of archives. The work is
+ * split into one step per archive, steps can run on any number of threads. An
+ * archive listed more than once is only scanned once.
+ * Only the header bytes are read, compressed textures are inflated just that far.
+ * Files that don't have a valid header or whose record can't be decoded, like
+ * lz4 compressed ones in skyrim se archives, are reported with all fields 0
+ */
+class TextureScan {
+public:
+  explicit TextureScan(std::vector<std::shared_ptr<ArchiveReader>> archives);
+
+  size_t numArchives() const { return m_Archives.size(); }
+
+  /**
+   * scan the next archive. Thread-safe
+   * @return false if there was none left
+   */
+  bool step();
+
+  /// headers of all textures in the order of the archives, once all steps are done
+  std::vector<TextureHeader> result() const;
+
+private:
+  std::vector<std::shared_ptr<ArchiveReader>> m_Archives;
+  // position of the first occurrence of each archive in the list
+  std::vector<size_t> m_First;
+  std::vector<std::vector<TextureHeader>> m_Headers;
+  std::atomic<size_t> m_Next{ 0 };
+};
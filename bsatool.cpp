@@ -0,0 +1,323 @@
+/**
+ * command line front end to the archive engine, built from the same sources as the
+ * node addon. Meant for batch jobs and for profiling the engine without node
+ */
+
+#include "bsaindex.h"
+#include "bsamanifest.h"
+#include "bsapath.h"
+#include "bsareader.h"
+#include "bsasearch.h"
+#include "bsasource.h"
+#include "bsatexture.h"
+#include "bsawriter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/// archive written to a regular file, seekable so it's written in a single pass
+class FileSink : public WriterSink {
+public:
+  explicit FileSink(const std::string &fileName)
+    : m_Stream(toNativePath(fileName), std::ios::binary | std::ios::trunc)
+  {
+    if (!m_Stream) {
+      throw std::runtime_error("access failed");
+    }
+  }
+
+  virtual void write(const uint8_t *data, size_t length) override {
+    if (!m_Stream.write(reinterpret_cast<const char*>(data), length)) {
+      throw std::runtime_error("access failed");
+    }
+  }
+
+  virtual bool seekable() const override { return true; }
+
+  virtual void seek(uint64_t position) override {
+    if (!m_Stream.seekp(static_cast<std::streamoff>(position))) {
+      throw std::runtime_error("access failed");
+    }
+  }
+
+  void close() {
+    m_Stream.close();
+    if (m_Stream.fail()) {
+      throw std::runtime_error("access failed");
+    }
+  }
+
+private:
+  std::ofstream m_Stream;
+};
+
+/// drops everything, for timing the writer without the disk
+class DiscardSink : public WriterSink {
+public:
+  virtual void write(const uint8_t*, size_t) override {}
+  virtual bool seekable() const override { return true; }
+  virtual void seek(uint64_t) override {}
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMS(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/// value of a --name option, the default if it wasn't passed
+std::string option(std::vector<std::string> &args, const std::string &name, const std::string &def) {
+  auto iter = std::find(args.begin(), args.end(), "--" + name);
+  if (iter == args.end()) {
+    return def;
+  }
+  if (iter + 1 == args.end()) {
+    throw std::runtime_error("missing value for --" + name);
+  }
+  std::string result = *(iter + 1);
+  args.erase(iter, iter + 2);
+  return result;
+}
+
+bool flag(std::vector<std::string> &args, const std::string &name) {
+  auto iter = std::find(args.begin(), args.end(), "--" + name);
+  if (iter == args.end()) {
+    return false;
+  }
+  args.erase(iter);
+  return true;
+}
+
+int list(std::vector<std::string> &args) {
+  if (args.size() != 1) {
+    throw std::invalid_argument("list <archive>");
+  }
+  std::shared_ptr<ArchiveReader> reader = ArchiveReader::open(args[0], false);
+  const ArchiveIndex &index = *reader->index();
+  for (uint32_t file = 0; file < index.numFiles(); ++file) {
+    printf("%10u %c %s\n", index.fileSize(file), index.fileCompressed(file) ? 'c' : '-',
+           index.filePath(file).c_str());
+  }
+  return 0;
+}
+
+int extract(std::vector<std::string> &args) {
+  std::string scheduleName = option(args, "schedule", "auto");
+  std::string manifestName = option(args, "manifest", "");
+  bool digests = flag(args, "crc32");
+  if (args.size() != 2) {
+    throw std::invalid_argument("extract <archive> <output directory> [--schedule auto|offset|path] "
+                                "[--manifest <file>] [--crc32]");
+  }
+  IOSchedule schedule = IOSchedule::AUTO;
+  if (scheduleName == "offset") {
+    schedule = IOSchedule::OFFSET;
+  } else if (scheduleName == "path") {
+    schedule = IOSchedule::OUTPUT_PATH;
+  } else if (scheduleName != "auto") {
+    throw std::runtime_error("invalid schedule");
+  }
+
+  std::shared_ptr<ArchiveReader> reader = ArchiveReader::open(args[0], false);
+  ExtractionManifest manifest(digests);
+  reader->extractAll(args[1], [](int, std::string) { return true; }, schedule,
+                     manifestName.empty() ? nullptr : &manifest);
+  if (!manifestName.empty()) {
+    // binary if the name says so, ndjson otherwise
+    if ((manifestName.size() > 4) && (manifestName.compare(manifestName.size() - 4, 4, ".bin") == 0)) {
+      manifest.writeBinary(*reader->index(), manifestName);
+    } else {
+      manifest.writeNDJSON(*reader->index(), manifestName);
+    }
+  }
+  return 0;
+}
+
+int pack(std::vector<std::string> &args) {
+  bool oblivion = flag(args, "oblivion");
+  bool compress = flag(args, "compress");
+  if (args.size() != 2) {
+    throw std::invalid_argument("pack <archive> <source directory> [--oblivion] [--compress]");
+  }
+
+  ArchiveWriter writer(oblivion ? ArchiveIndex::VERSION_OBLIVION : ArchiveIndex::VERSION_SKYRIM);
+  fs::path base = toNativePath(args[1]);
+  for (const fs::directory_entry &entry : fs::recursive_directory_iterator(base)) {
+    if (entry.is_regular_file()) {
+      std::string relative = entry.path().lexically_relative(base).u8string();
+      std::replace(relative.begin(), relative.end(), '/', '\\');
+      writer.addFile(relative, makeFileSource(entry.path().u8string()), compress);
+    }
+  }
+
+  FileSink sink(args[0]);
+  writer.write(sink);
+  sink.close();
+  return 0;
+}
+
+int verify(std::vector<std::string> &args) {
+  if (args.size() != 1) {
+    throw std::invalid_argument("verify <archive>");
+  }
+  // hashes are tested while parsing, every file has to decode
+  std::shared_ptr<ArchiveReader> reader = ArchiveReader::open(args[0], true);
+  const ArchiveIndex &index = *reader->index();
+  std::vector<uint8_t> data;
+  uint32_t failed = 0;
+  for (uint32_t file = 0; file < index.numFiles(); ++file) {
+    try {
+      reader->read(file, data);
+    }
+    catch (const std::exception &e) {
+      fprintf(stderr, "%s: %s\n", index.filePath(file).c_str(), e.what());
+      ++failed;
+    }
+  }
+  printf("%u files, %u failed\n", index.numFiles(), failed);
+  return failed == 0 ? 0 : 1;
+}
+
+int bench(std::vector<std::string> &args) {
+  int iterations = std::atoi(option(args, "iterations", "5").c_str());
+  if ((args.size() != 1) || (iterations < 1)) {
+    throw std::invalid_argument("bench <archive> [--iterations n]");
+  }
+
+  // best of n runs, the first one warms the page cache
+  std::map<std::string, double> best;
+  auto measure = [&best](const std::string &name, const std::function<void()> &func) {
+    Clock::time_point start = Clock::now();
+    func();
+    double time = elapsedMS(start);
+    auto iter = best.find(name);
+    if ((iter == best.end()) || (time < iter->second)) {
+      best[name] = time;
+    }
+  };
+
+  uint64_t bytes = 0;
+  for (int i = 0; i < iterations; ++i) {
+    std::shared_ptr<ArchiveReader> reader;
+    measure("parse", [&]() { reader = ArchiveReader::open(args[0], false); });
+    const ArchiveIndex &index = *reader->index();
+
+    measure("read all", [&]() {
+      std::vector<uint8_t> data;
+      bytes = 0;
+      for (uint32_t file = 0; file < index.numFiles(); ++file) {
+        reader->read(file, data);
+        bytes += data.size();
+      }
+    });
+
+    measure("scan textures", [&]() {
+      TextureScan scan({ reader });
+      while (scan.step()) {
+      }
+      scan.result();
+    });
+
+    // the index of an archive with the same paths and no content
+    measure("write index", [&]() {
+      static const uint8_t empty = 0;
+      ArchiveWriter writer(index.version() == ArchiveIndex::VERSION_OBLIVION
+                           ? ArchiveIndex::VERSION_OBLIVION : ArchiveIndex::VERSION_SKYRIM);
+      for (uint32_t file = 0; file < index.numFiles(); ++file) {
+        writer.addFile(index.filePath(file), makeMemorySource(&empty, 0), false);
+      }
+      DiscardSink sink;
+      writer.write(sink);
+    });
+
+    measure("search", [&]() {
+      for (SearchMode mode : { SearchMode::PREFIX, SearchMode::SUFFIX, SearchMode::CONTAINS }) {
+        index.pathIndex().search(mode, ".dds", 0, UINT32_MAX);
+      }
+    });
+
+    // every path of the archive in one buffer, canonicalized one path at a time the
+    // way the writer and search queries do it
+    std::string paths;
+    std::vector<size_t> offsets{ 0 };
+    for (uint32_t file = 0; file < index.numFiles(); ++file) {
+      paths += index.filePath(file);
+      offsets.push_back(paths.size());
+    }
+    std::vector<PathKernel> kernels{ PathKernel::SCALAR };
+    if (bestPathKernel() != PathKernel::SCALAR) {
+      kernels.push_back(PathKernel::SSE2);
+    }
+    for (PathKernel kernel : kernels) {
+      measure(std::string("paths ") + pathKernelName(kernel), [&]() {
+        for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+          canonicalizePath(&paths[offsets[i]], offsets[i + 1] - offsets[i], kernel);
+        }
+      });
+    }
+  }
+
+  for (const auto &iter : best) {
+    printf("%-14s %10.3f ms\n", iter.first.c_str(), iter.second);
+  }
+  printf("%-14s %10.1f MB/s\n", "read rate", (bytes / (1024.0 * 1024.0)) / (best["read all"] / 1000.0));
+  return 0;
+}
+
+void usage() {
+  fprintf(stderr,
+    "usage: bsatool <command> ...\n"
+    "  list <archive>\n"
+    "  extract <archive> <output directory> [--schedule auto|offset|path] [--manifest <file>] [--crc32]\n"
+    "  pack <archive> <source directory> [--oblivion] [--compress]\n"
+    "  verify <archive>\n"
+    "  bench <archive> [--iterations n]\n");
+}
+
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+
+  const std::map<std::string, std::function<int(std::vector<std::string>&)>> commands = {
+    { "list", list },
+    { "extract", extract },
+    { "pack", pack },
+    { "verify", verify },
+    { "bench", bench },
+  };
+
+  auto command = commands.find(argv[1]);
+  if (command == commands.end()) {
+    usage();
+    return 2;
+  }
+
+  std::vector<std::string> args(argv + 2, argv + argc);
+  try {
+    return command->second(args);
+  }
+  catch (const std::invalid_argument &e) {
+    fprintf(stderr, "usage: bsatool %s\n", e.what());
+    return 2;
+  }
+  catch (const std::exception &e) {
+    fprintf(stderr, "bsatool: %s\n", e.what());
+    return 1;
+  }
+}
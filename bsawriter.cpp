@@ -0,0 +1,547 @@
+#include "bsawriter.h"
+#include "bsaindex.h"
+#include "bsapath.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <zlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static const size_t CHUNK_SIZE = 64 * 1024;
+static const uint32_t HEADER_SIZE = 36;
+static const uint32_t FOLDER_RECORD_SIZE = 16;
+static const uint32_t FILE_RECORD_SIZE = 16;
+static const uint32_t MAX_RECORD_SIZE = 0x3FFFFFFF;
+static const uint32_t SIZE_COMPRESSTOGGLE = 0x40000000;
+// below this many entries per thread hashing isn't worth starting threads for
+static const size_t MIN_HASH_ENTRIES = 16384;
+// below this many entries a comparison sort of the keys is faster than the radix sort
+static const size_t MIN_RADIX_ENTRIES = 128 * 1024;
+
+namespace {
+
+class FileSource : public WriterSource {
+public:
+  explicit FileSource(const std::string &fileName)
+    : m_Path(fs::u8path(fileName))
+  {
+    std::error_code ec;
+    m_Size = fs::file_size(m_Path, ec);
+    if (ec) {
+      throw std::runtime_error("source file missing");
+    }
+  }
+
+  virtual uint64_t size() const override { return m_Size; }
+
+  virtual size_t read(uint8_t *buffer, size_t length) override {
+    if (!m_File.is_open()) {
+      m_File.open(m_Path, std::ios::in | std::ios::binary);
+      if (!m_File.is_open()) {
+        throw std::runtime_error("source file missing");
+      }
+    }
+    m_File.read(reinterpret_cast<char*>(buffer), length);
+    return static_cast<size_t>(m_File.gcount());
+  }
+
+  virtual void rewind() override {
+    // reopened on the next read, that way we don't keep thousands of handles open
+    m_File.close();
+  }
+
+private:
+  fs::path m_Path;
+  uint64_t m_Size;
+  std::ifstream m_File;
+};
+
+class MemorySource : public WriterSource {
+public:
+  MemorySource(const uint8_t *data, size_t size)
+    : m_Data(data), m_Size(size)
+  {}
+
+  virtual uint64_t size() const override { return m_Size; }
+
+  virtual size_t read(uint8_t *buffer, size_t length) override {
+    size_t count = std::min(length, m_Size - m_Pos);
+    memcpy(buffer, m_Data + m_Pos, count);
+    m_Pos += count;
+    return count;
+  }
+
+  virtual void rewind() override { m_Pos = 0; }
+
+private:
+  const uint8_t *m_Data;
+  size_t m_Size;
+  size_t m_Pos{ 0 };
+};
+
+class HandleSink : public WriterSink {
+public:
+#ifdef _WIN32
+  explicit HandleSink(void *handle)
+    : m_Handle(handle)
+  {
+    LARGE_INTEGER zero{}, pos{};
+    m_Seekable = (GetFileType(m_Handle) == FILE_TYPE_DISK)
+      && SetFilePointerEx(m_Handle, zero, &pos, FILE_CURRENT);
+    m_Base = pos.QuadPart;
+  }
+
+  virtual void write(const uint8_t *data, size_t length) override {
+    while (length > 0) {
+      DWORD written = 0;
+      DWORD chunk = static_cast<DWORD>(std::min<size_t>(length, CHUNK_SIZE));
+      if (!WriteFile(m_Handle, data, chunk, &written, nullptr)) {
+        throw std::runtime_error("access failed");
+      }
+      data += written;
+      length -= written;
+    }
+  }
+
+  virtual void seek(uint64_t position) override {
+    LARGE_INTEGER pos;
+    pos.QuadPart = m_Base + position;
+    if (!SetFilePointerEx(m_Handle, pos, nullptr, FILE_BEGIN)) {
+      throw std::runtime_error("access failed");
+    }
+  }
+#else
+  explicit HandleSink(int fd)
+    : m_Handle(fd)
+  {
+    struct stat info;
+    off_t pos = lseek(m_Handle, 0, SEEK_CUR);
+    m_Seekable = (fstat(m_Handle, &info) == 0) && S_ISREG(info.st_mode) && (pos != -1);
+    m_Base = m_Seekable ? pos : 0;
+  }
+
+  virtual void write(const uint8_t *data, size_t length) override {
+    while (length > 0) {
+      ssize_t written = ::write(m_Handle, data, length);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error("access failed");
+      }
+      data += written;
+      length -= written;
+    }
+  }
+
+  virtual void seek(uint64_t position) override {
+    if (lseek(m_Handle, static_cast<off_t>(m_Base + position), SEEK_SET) == -1) {
+      throw std::runtime_error("access failed");
+    }
+  }
+#endif
+
+  virtual bool seekable() const override { return m_Seekable; }
+
+private:
+#ifdef _WIN32
+  void *m_Handle;
+#else
+  int m_Handle;
+#endif
+  bool m_Seekable;
+  uint64_t m_Base;
+};
+
+template <typename T> void append(std::vector<uint8_t> &buffer, T value) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+/// entry of the archive in the order of the index
+struct SortKey {
+  uint64_t folderHash;
+  uint64_t nameHash;
+  uint32_t entry;
+};
+
+bool keyLess(const SortKey &lhs, const SortKey &rhs) {
+  return (lhs.folderHash != rhs.folderHash)
+    ? lhs.folderHash < rhs.folderHash
+    : lhs.nameHash < rhs.nameHash;
+}
+
+/**
+ * stable lsd radix sort by folder hash, then name hash, 11 bits per pass. The
+ * histograms of all passes are built in one read of the keys, passes in which all
+ * keys have the same digit are skipped
+ */
+void radixSort(std::vector<SortKey> &keys) {
+  static constexpr int DIGIT_BITS = 11;
+  static constexpr uint32_t NUM_BUCKETS = 1 << DIGIT_BITS;
+  static constexpr uint64_t DIGIT_MASK = NUM_BUCKETS - 1;
+  // per hash, name hash first
+  static constexpr int HASH_PASSES = (64 + DIGIT_BITS - 1) / DIGIT_BITS;
+
+  if (keys.size() < MIN_RADIX_ENTRIES) {
+    std::sort(keys.begin(), keys.end(), keyLess);
+    return;
+  }
+
+  std::vector<uint32_t> counts(2 * HASH_PASSES * NUM_BUCKETS, 0);
+  for (const SortKey &key : keys) {
+    for (int pass = 0; pass < HASH_PASSES; ++pass) {
+      ++counts[pass * NUM_BUCKETS + ((key.nameHash >> (pass * DIGIT_BITS)) & DIGIT_MASK)];
+      ++counts[(HASH_PASSES + pass) * NUM_BUCKETS + ((key.folderHash >> (pass * DIGIT_BITS)) & DIGIT_MASK)];
+    }
+  }
+
+  std::vector<SortKey> buffer(keys.size());
+  for (int pass = 0; pass < 2 * HASH_PASSES; ++pass) {
+    uint64_t SortKey::*hash = pass < HASH_PASSES ? &SortKey::nameHash : &SortKey::folderHash;
+    int shift = (pass % HASH_PASSES) * DIGIT_BITS;
+    uint32_t *offsets = &counts[pass * NUM_BUCKETS];
+    if (offsets[(keys[0].*hash >> shift) & DIGIT_MASK] == keys.size()) {
+      continue;
+    }
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < NUM_BUCKETS; ++i) {
+      uint32_t next = offset + offsets[i];
+      offsets[i] = offset;
+      offset = next;
+    }
+    for (const SortKey &key : keys) {
+      buffer[offsets[(key.*hash >> shift) & DIGIT_MASK]++] = key;
+    }
+    keys.swap(buffer);
+  }
+}
+
+// content flags in the archive header, the games use them to decide which
+// archives to search for a type of file
+uint16_t fileFlag(const std::string &name) {
+  size_t dot = name.find_last_of('.');
+  std::string ext = dot == std::string::npos ? std::string() : name.substr(dot);
+  if (ext == ".nif") return 0x1;
+  if (ext == ".dds") return 0x2;
+  if (ext == ".xml") return 0x4;
+  if (ext == ".wav") return 0x8;
+  if ((ext == ".mp3") || (ext == ".ogg")) return 0x10;
+  if ((ext == ".txt") || (ext == ".html") || (ext == ".bat") || (ext == ".scc")) return 0x20;
+  if (ext == ".spt") return 0x40;
+  if ((ext == ".tex") || (ext == ".fnt")) return 0x80;
+  if (ext == ".ctl") return 0x100;
+  return 0;
+}
+
+}
+
+std::unique_ptr<WriterSource> makeFileSource(const std::string &fileName) {
+  return std::unique_ptr<WriterSource>(new FileSource(fileName));
+}
+
+std::unique_ptr<WriterSource> makeMemorySource(const uint8_t *data, size_t size) {
+  return std::unique_ptr<WriterSource>(new MemorySource(data, size));
+}
+
+#ifdef _WIN32
+std::unique_ptr<WriterSink> makeHandleSink(void *handle) {
+  return std::unique_ptr<WriterSink>(new HandleSink(handle));
+}
+#else
+std::unique_ptr<WriterSink> makeHandleSink(int fd) {
+  return std::unique_ptr<WriterSink>(new HandleSink(fd));
+}
+#endif
+
+ArchiveWriter::ArchiveWriter(uint32_t version)
+  : m_Version(version)
+{
+  if ((version != ArchiveIndex::VERSION_OBLIVION) && (version != ArchiveIndex::VERSION_SKYRIM)) {
+    throw std::runtime_error("unsupported archive version");
+  }
+}
+
+void ArchiveWriter::splitPath(const std::string &filePath, std::string &folder, std::string &name) {
+  std::string path(filePath);
+  normalizePath(path);
+
+  size_t sep = path.find_last_of('\\');
+  folder = sep == std::string::npos ? "." : path.substr(0, sep);
+  name = sep == std::string::npos ? path : path.substr(sep + 1);
+  if (name.empty() || (name.size() > 254) || (folder.size() > 254)) {
+    throw std::runtime_error("invalid file name");
+  }
+}
+
+void ArchiveWriter::checkFile(const std::string &filePath, uint64_t size) {
+  std::string folder;
+  std::string name;
+  splitPath(filePath, folder, name);
+  if (size > MAX_RECORD_SIZE) {
+    throw std::runtime_error("file too large");
+  }
+}
+
+void ArchiveWriter::addFile(const std::string &filePath, std::unique_ptr<WriterSource> source,
+                            bool compressed) {
+  Entry entry;
+  splitPath(filePath, entry.folder, entry.name);
+  if (source->size() > MAX_RECORD_SIZE) {
+    throw std::runtime_error("file too large");
+  }
+  entry.folderHash = 0;
+  entry.nameHash = 0;
+  entry.source = std::move(source);
+  entry.compressed = compressed;
+  entry.size = 0;
+  entry.offset = 0;
+  m_Entries.push_back(std::move(entry));
+}
+
+void ArchiveWriter::hashEntries() {
+  auto hashRange = [this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      Entry &entry = m_Entries[i];
+      entry.folderHash = calculateBSAFolderHash(entry.folder.c_str(), entry.folder.size());
+      entry.nameHash = calculateBSAHash(entry.name.c_str(), entry.name.size());
+    }
+  };
+
+  size_t numThreads = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1U),
+                                       m_Entries.size() / MIN_HASH_ENTRIES);
+  if (numThreads <= 1) {
+    hashRange(0, m_Entries.size());
+    return;
+  }
+
+  size_t perThread = (m_Entries.size() + numThreads - 1) / numThreads;
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < numThreads; ++i) {
+    threads.emplace_back(hashRange, i * perThread, std::min(m_Entries.size(), (i + 1) * perThread));
+  }
+  hashRange(0, perThread);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+void ArchiveWriter::sortEntries(std::vector<FolderGroup> &groups) {
+  hashEntries();
+
+  // the games binary search folders and files by hash. The keys get sorted, the
+  // entries are moved into place once
+  std::vector<SortKey> keys(m_Entries.size());
+  for (size_t i = 0; i < m_Entries.size(); ++i) {
+    keys[i] = { m_Entries[i].folderHash, m_Entries[i].nameHash, static_cast<uint32_t>(i) };
+  }
+  radixSort(keys);
+  std::vector<Entry> sorted;
+  sorted.reserve(m_Entries.size());
+  for (const SortKey &key : keys) {
+    sorted.push_back(std::move(m_Entries[key.entry]));
+  }
+  m_Entries.swap(sorted);
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if ((i > 0) && (keys[i].folderHash == keys[i - 1].folderHash)) {
+      if (keys[i].nameHash == keys[i - 1].nameHash) {
+        throw std::runtime_error("duplicate file " + m_Entries[i].folder + "\\" + m_Entries[i].name);
+      }
+      groups.back().end = i + 1;
+    } else {
+      groups.push_back({ i, i + 1 });
+    }
+  }
+}
+
+void ArchiveWriter::writeIndex(WriterSink &sink, const std::vector<FolderGroup> &groups) {
+  uint32_t totalFolderNameLength = 0;
+  uint32_t totalFileNameLength = 0;
+  uint16_t fileFlags = 0;
+  for (const FolderGroup &group : groups) {
+    totalFolderNameLength += static_cast<uint32_t>(m_Entries[group.begin].folder.size() + 1);
+  }
+  for (const Entry &entry : m_Entries) {
+    totalFileNameLength += static_cast<uint32_t>(entry.name.size() + 1);
+    fileFlags |= fileFlag(entry.name);
+  }
+
+  std::vector<uint8_t> buffer;
+  buffer.insert(buffer.end(), { 'B', 'S', 'A', '\0' });
+  append<uint32_t>(buffer, m_Version);
+  append<uint32_t>(buffer, HEADER_SIZE);
+  // folder names and file names included, compression is toggled per file
+  append<uint32_t>(buffer, 0x3);
+  append<uint32_t>(buffer, static_cast<uint32_t>(groups.size()));
+  append<uint32_t>(buffer, static_cast<uint32_t>(m_Entries.size()));
+  append<uint32_t>(buffer, totalFolderNameLength);
+  append<uint32_t>(buffer, totalFileNameLength);
+  append<uint16_t>(buffer, fileFlags);
+  append<uint16_t>(buffer, 0);
+
+  // folder records point at the folder's block of file records, offset by the
+  // file name table for reasons only bethesda knows
+  uint32_t blockOffset = HEADER_SIZE + static_cast<uint32_t>(groups.size()) * FOLDER_RECORD_SIZE;
+  for (const FolderGroup &group : groups) {
+    const Entry &first = m_Entries[group.begin];
+    append<uint64_t>(buffer, first.folderHash);
+    append<uint32_t>(buffer, static_cast<uint32_t>(group.end - group.begin));
+    append<uint32_t>(buffer, blockOffset + totalFileNameLength);
+    blockOffset += static_cast<uint32_t>(1 + first.folder.size() + 1
+                                         + (group.end - group.begin) * FILE_RECORD_SIZE);
+  }
+
+  for (const FolderGroup &group : groups) {
+    const std::string &folder = m_Entries[group.begin].folder;
+    buffer.push_back(static_cast<uint8_t>(folder.size() + 1));
+    buffer.insert(buffer.end(), folder.begin(), folder.end());
+    buffer.push_back('\0');
+    for (size_t i = group.begin; i < group.end; ++i) {
+      const Entry &entry = m_Entries[i];
+      append<uint64_t>(buffer, entry.nameHash);
+      append<uint32_t>(buffer, entry.compressed ? (entry.size | SIZE_COMPRESSTOGGLE) : entry.size);
+      append<uint32_t>(buffer, entry.offset);
+    }
+  }
+
+  for (const Entry &entry : m_Entries) {
+    buffer.insert(buffer.end(), entry.name.begin(), entry.name.end());
+    buffer.push_back('\0');
+  }
+
+  sink.write(buffer.data(), buffer.size());
+}
+
+uint32_t ArchiveWriter::writeData(WriterSink *sink, Entry &entry) {
+  WriterSource &source = *entry.source;
+  source.rewind();
+  m_InBuffer.resize(CHUNK_SIZE);
+  uint64_t total = 0;
+
+  if (!entry.compressed) {
+    size_t count;
+    while ((count = source.read(m_InBuffer.data(), CHUNK_SIZE)) > 0) {
+      if (sink != nullptr) {
+        sink->write(m_InBuffer.data(), count);
+      }
+      total += count;
+    }
+    if (total != source.size()) {
+      throw std::runtime_error("source size mismatch");
+    }
+    return static_cast<uint32_t>(total);
+  }
+
+  uint32_t originalSize = static_cast<uint32_t>(source.size());
+  if (sink != nullptr) {
+    sink->write(reinterpret_cast<const uint8_t*>(&originalSize), sizeof(uint32_t));
+  }
+
+  z_stream stream{};
+  if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    throw std::runtime_error("zlib init failed");
+  }
+  m_OutBuffer.resize(CHUNK_SIZE);
+  uint64_t read = 0;
+  uint64_t written = sizeof(uint32_t);
+  int res = Z_OK;
+  try {
+    while (res != Z_STREAM_END) {
+      int flush = Z_NO_FLUSH;
+      if (stream.avail_in == 0) {
+        size_t count = source.read(m_InBuffer.data(), CHUNK_SIZE);
+        read += count;
+        stream.next_in = m_InBuffer.data();
+        stream.avail_in = static_cast<uInt>(count);
+        if (count == 0) {
+          flush = Z_FINISH;
+        }
+      }
+      do {
+        stream.next_out = m_OutBuffer.data();
+        stream.avail_out = static_cast<uInt>(m_OutBuffer.size());
+        res = deflate(&stream, flush);
+        if (res == Z_STREAM_ERROR) {
+          throw std::runtime_error("invalid data");
+        }
+        size_t produced = m_OutBuffer.size() - stream.avail_out;
+        if ((sink != nullptr) && (produced > 0)) {
+          sink->write(m_OutBuffer.data(), produced);
+        }
+        written += produced;
+      } while ((stream.avail_out == 0) && (res != Z_STREAM_END));
+    }
+  }
+  catch (...) {
+    deflateEnd(&stream);
+    throw;
+  }
+  deflateEnd(&stream);
+
+  if (read != originalSize) {
+    throw std::runtime_error("source size mismatch");
+  }
+  if (written > MAX_RECORD_SIZE) {
+    throw std::runtime_error("file too large");
+  }
+  return static_cast<uint32_t>(written);
+}
+
+void ArchiveWriter::write(WriterSink &sink) {
+  std::vector<FolderGroup> groups;
+  sortEntries(groups);
+
+  uint64_t dataOffset = HEADER_SIZE + groups.size() * FOLDER_RECORD_SIZE;
+  for (const FolderGroup &group : groups) {
+    dataOffset += 1 + m_Entries[group.begin].folder.size() + 1;
+  }
+  for (const Entry &entry : m_Entries) {
+    dataOffset += FILE_RECORD_SIZE + entry.name.size() + 1;
+  }
+
+  if (sink.seekable()) {
+    // write the index with placeholders, fill in sizes and offsets at the end
+    writeIndex(sink, groups);
+    for (Entry &entry : m_Entries) {
+      if (dataOffset > UINT32_MAX) {
+        throw std::runtime_error("archive too large");
+      }
+      entry.offset = static_cast<uint32_t>(dataOffset);
+      entry.size = writeData(&sink, entry);
+      dataOffset += entry.size;
+    }
+    sink.seek(0);
+    writeIndex(sink, groups);
+  } else {
+    // first pass determines the compressed sizes without writing anything
+    for (Entry &entry : m_Entries) {
+      entry.size = entry.compressed
+        ? writeData(nullptr, entry)
+        : static_cast<uint32_t>(entry.source->size());
+      if (dataOffset > UINT32_MAX) {
+        throw std::runtime_error("archive too large");
+      }
+      entry.offset = static_cast<uint32_t>(dataOffset);
+      dataOffset += entry.size;
+    }
+    writeIndex(sink, groups);
+    for (Entry &entry : m_Entries) {
+      if (writeData(&sink, entry) != entry.size) {
+        throw std::runtime_error("source changed while writing");
+      }
+    }
+  }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * data to be stored in an archive. Sources are read sequentially, in chunks, and
+ * may be rewound when the archive has to be written in two passes
+ */
+class WriterSource {
+public:
+  virtual ~WriterSource() {}
+  /// declared size of the data, the source has to provide exactly this many bytes
+  virtual uint64_t size() const = 0;
+  /// read up to length bytes, returns 0 at the end of the data
+  virtual size_t read(uint8_t *buffer, size_t length) = 0;
+  virtual void rewind() = 0;
+};
+
+/**
+ * target of an archive being written
+ */
+class WriterSink {
+public:
+  virtual ~WriterSink() {}
+  virtual void write(const uint8_t *data, size_t length) = 0;
+  /// true if seek is supported, otherwise the archive is written in two passes
+  virtual bool seekable() const = 0;
+  /// move to the position, relative to where the archive started
+  virtual void seek(uint64_t position) = 0;
+};
+
+std::unique_ptr<WriterSource> makeFileSource(const std::string &fileName);
+std::unique_ptr<WriterSource> makeMemorySource(const uint8_t *data, size_t size);
+#ifdef _WIN32
+std::unique_ptr<WriterSink> makeHandleSink(void *handle);
+#else
+std::unique_ptr<WriterSink> makeHandleSink(int fd);
+#endif
+
+/**
+ * writes bsas with bounded memory use. All file names are known up front and the
+ * index is laid out from the declared sizes, file data is streamed through zlib in
+ * chunks.
+ * Names are hashed when the archive gets written, on several threads for large
+ * archives, and the entries are put in hash order with a radix sort.
+ * With a seekable sink the index is written with placeholder sizes and offsets
+ * which get filled in once all data is written. Otherwise compressed sources are
+ * compressed twice, once to determine their size and once to write them.
+ */
+class ArchiveWriter {
+public:
+  explicit ArchiveWriter(uint32_t version);
+
+  /**
+   * @param filePath path of the file inside the archive
+   * @throws std::runtime_error if the path is invalid
+   */
+  void addFile(const std::string &filePath, std::unique_ptr<WriterSource> source, bool compressed);
+
+  /**
+   * check that a file can be added without adding it, e.g. for sources that can
+   * only be created later
+   * @throws std::runtime_error if the path is invalid or the file too large
+   */
+  static void checkFile(const std::string &filePath, uint64_t size);
+
+  /// @throws std::runtime_error
+  void write(WriterSink &sink);
+
+private:
+  struct Entry {
+    std::string folder;
+    std::string name;
+    uint64_t folderHash;
+    uint64_t nameHash;
+    std::unique_ptr<WriterSource> source;
+    bool compressed;
+    uint32_t size;
+    uint32_t offset;
+  };
+
+  struct FolderGroup {
+    size_t begin;
+    size_t end;
+  };
+
+private:
+  /// @throws std::runtime_error if the path is invalid
+  static void splitPath(const std::string &filePath, std::string &folder, std::string &name);
+  void hashEntries();
+  void sortEntries(std::vector<FolderGroup> &groups);
+  void writeIndex(WriterSink &sink, const std::vector<FolderGroup> &groups);
+  uint32_t writeData(WriterSink *sink, Entry &entry);
+
+private:
+  uint32_t m_Version;
+  std::vector<Entry> m_Entries;
+  std::vector<uint8_t> m_InBuffer;
+  std::vector<uint8_t> m_OutBuffer;
+};
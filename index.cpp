@@ -1,7 +1,31 @@
 #include "bsatk/src/bsaarchive.h"
-#include "string_cast.h"
+#include "bsabudget.h"
+#include "bsadeploy.h"
+#include "bsahandles.h"
+#include "bsamanifest.h"
+#include "bsamemory.h"
+#include "bsametrics.h"
+#include "bsapath.h"
+#include "bsareader.h"
+#include "bsascheduler.h"
+#include "bsasearch.h"
+#include "bsashared.h"
+#include "bsatexture.h"
+#include "bsawriter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <napi.h>
+#ifdef _WIN32
+#include <uv.h>
+#endif
 
 const char *convertErrorCode(BSA::EErrorCode code) {
   switch (code) {
@@ -36,32 +60,422 @@ private:
   const char *m_SysCall;
 };
 
+/// priority option of an asynchronous call, normal if not set
+WorkScheduler::Priority priorityOption(Napi::Env env, const Napi::Value &options) {
+  if (!options.IsObject() || !options.ToObject().Has("priority")) {
+    return WorkScheduler::Priority::NORMAL;
+  }
+  std::string name = options.ToObject().Get("priority").ToString();
+  if (name == "interactive") {
+    return WorkScheduler::Priority::INTERACTIVE;
+  } else if (name == "background") {
+    return WorkScheduler::Priority::BACKGROUND;
+  } else if (name != "normal") {
+    throw Napi::TypeError::New(env, "invalid priority");
+  }
+  return WorkScheduler::Priority::NORMAL;
+}
+
+/// schedule option of an extraction, auto if not set
+IOSchedule scheduleOption(Napi::Env env, const Napi::Value &options) {
+  if (!options.IsObject() || !options.ToObject().Has("schedule")) {
+    return IOSchedule::AUTO;
+  }
+  std::string name = options.ToObject().Get("schedule").ToString();
+  if (name == "offset") {
+    return IOSchedule::OFFSET;
+  } else if (name == "path") {
+    return IOSchedule::OUTPUT_PATH;
+  } else if (name != "auto") {
+    throw Napi::TypeError::New(env, "invalid schedule");
+  }
+  return IOSchedule::AUTO;
+}
+
+SearchMode searchModeOption(Napi::Env env, const Napi::Value &name) {
+  std::string modeName = name.ToString();
+  if (modeName == "suffix") {
+    return SearchMode::SUFFIX;
+  } else if (modeName == "contains") {
+    return SearchMode::CONTAINS;
+  } else if (modeName != "prefix") {
+    throw Napi::TypeError::New(env, "invalid search mode");
+  }
+  return SearchMode::PREFIX;
+}
+
+/// manifest option of extractAll
+struct ManifestRequest {
+  enum class Format { NONE, NDJSON, BINARY, ARRAYS };
+
+  Format format{ Format::NONE };
+  /// output file for ndjson and binary
+  std::string path;
+  bool digests{ false };
+};
+
+ManifestRequest manifestOption(Napi::Env env, const Napi::Value &options) {
+  ManifestRequest result;
+  if (!options.IsObject() || !options.ToObject().Has("manifest")) {
+    return result;
+  }
+  Napi::Value manifest = options.ToObject().Get("manifest");
+  if (!manifest.IsObject()) {
+    throw Napi::TypeError::New(env, "invalid manifest");
+  }
+  Napi::Object request = manifest.ToObject();
+  std::string format = request.Get("format").ToString();
+  if (format == "ndjson") {
+    result.format = ManifestRequest::Format::NDJSON;
+  } else if (format == "binary") {
+    result.format = ManifestRequest::Format::BINARY;
+  } else if (format == "arrays") {
+    result.format = ManifestRequest::Format::ARRAYS;
+  } else {
+    throw Napi::TypeError::New(env, "invalid manifest format");
+  }
+  if (result.format != ManifestRequest::Format::ARRAYS) {
+    if (!request.Get("path").IsString()) {
+      throw Napi::TypeError::New(env, "manifest path required");
+    }
+    result.path = request.Get("path").ToString();
+  }
+  result.digests = request.Has("crc32") && request.Get("crc32").ToBoolean();
+  return result;
+}
+
+/// write the manifest to its file if one was requested. Runs on the worker thread
+void saveManifest(const ManifestRequest &request, const ExtractionManifest &manifest, const ArchiveIndex &index) {
+  if (request.format == ManifestRequest::Format::NDJSON) {
+    manifest.writeNDJSON(index, request.path);
+  } else if (request.format == ManifestRequest::Format::BINARY) {
+    manifest.writeBinary(index, request.path);
+  }
+}
+
+/// callback result of an extraction, { paths, sizes, crc32 } if arrays were requested
+Napi::Value manifestResult(Napi::Env env, const ManifestRequest &request,
+                           const ExtractionManifest *manifest, const ArchiveIndex &index) {
+  if ((request.format != ManifestRequest::Format::ARRAYS) || (manifest == nullptr)) {
+    return env.Undefined();
+  }
+  std::vector<ManifestEntry> entries = manifest->entries();
+  Napi::Array paths = Napi::Array::New(env, entries.size());
+  Napi::Float64Array sizes = Napi::Float64Array::New(env, entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    paths.Set(static_cast<uint32_t>(i), Napi::String::New(env, index.filePath(entries[i].file)));
+    sizes[i] = static_cast<double>(entries[i].size);
+  }
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("paths", paths);
+  result.Set("sizes", sizes);
+  if (manifest->digests()) {
+    Napi::Uint32Array digests = Napi::Uint32Array::New(env, entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      digests[i] = entries[i].crc32;
+    }
+    result.Set("crc32", digests);
+  }
+  return result;
+}
+
+class ScheduledWorker;
+
 class BSAddon : public Napi::Addon<BSAddon> {
 public:
   BSAddon(Napi::Env env, Napi::Object exports);
+  ~BSAddon();
 
   Napi::FunctionReference constructArchive;
   Napi::FunctionReference constructFolder;
   Napi::FunctionReference constructFile;
+  Napi::FunctionReference constructWriter;
+
+  /// threads that run all asynchronous work of the addon
+  WorkScheduler &scheduler() { return *m_Scheduler; }
+
+  /// keep the event loop alive until the worker finished. Main thread only
+  void beginWork(Napi::Env env);
+  /// hand a finished worker back to the main thread, from any thread
+  void finishWork(ScheduledWorker *worker);
+
+  /**
+   * tell v8 how much native memory the addon holds now. Indexes, buffers and
+   * workers aren't tied to one env, every instance of the addon reports an equal
+   * share of the process total so the isolates together see the real figure.
+   * Main thread only
+   */
+  void syncExternalMemory(Napi::Env env);
 
 private:
+  Napi::Object attachEntry(Napi::Env env, const IndexRegistry::Entry &entry);
+
   Napi::Value loadBSA(const Napi::CallbackInfo& info);
+  Napi::Value loadBSAFromBuffer(const Napi::CallbackInfo& info);
+  Napi::Value loadBSAFromReader(const Napi::CallbackInfo& info);
   Napi::Value createBSA(const Napi::CallbackInfo& info);
+  Napi::Value createWriter(const Napi::CallbackInfo& info);
+  Napi::Value attachBSA(const Napi::CallbackInfo& info);
+  Napi::Value releaseIndex(const Napi::CallbackInfo& info);
+  Napi::Value attachSharedBSA(const Napi::CallbackInfo& info);
+  Napi::Value unpublishIndex(const Napi::CallbackInfo& info);
+  Napi::Value scanTextureHeaders(const Napi::CallbackInfo& info);
+  Napi::Value extractArchives(const Napi::CallbackInfo& info);
+  Napi::Value setMemoryBudget(const Napi::CallbackInfo& info);
+  Napi::Value setMaxOpenArchives(const Napi::CallbackInfo& info);
+  Napi::Value configureScheduler(const Napi::CallbackInfo& info);
+  Napi::Value getMetrics(const Napi::CallbackInfo& info);
+  Napi::Value getMemoryUsage(const Napi::CallbackInfo& info);
+
+  static void stopScheduler(void *scheduler);
+
+private:
+  // extraction is mostly waiting on the disk, a few threads keep it busy
+  static constexpr unsigned DEFAULT_IO_WORKERS = 4;
+  static constexpr unsigned MAX_WORKERS = 256;
+
+  napi_env m_Env;
+  std::unique_ptr<WorkScheduler> m_Scheduler;
+  // delivers finished workers to the main thread. Only referenced while work is
+  // pending so it doesn't keep the process alive by itself
+  Napi::ThreadSafeFunction m_Completions;
+  size_t m_PendingWork{ 0 };
+  // native memory last reported through AdjustExternalMemory
+  int64_t m_ReportedMemory{ 0 };
+
+  // addon instances alive in the process, one per env that loaded it
+  static std::atomic<int64_t> s_Instances;
+};
+
+std::atomic<int64_t> BSAddon::s_Instances{ 0 };
+
+/**
+ * asynchronous work run by the addon's scheduler instead of the libuv pool,
+ * otherwise used like Napi::AsyncWorker.
+ * Work can be split into steps, each step is queued again behind the work of
+ * other keys so one archive can't monopolize the workers
+ */
+class ScheduledWorker : public CountedObject<MemoryCategory::WORKERS> {
+public:
+  virtual ~ScheduledWorker() {}
+
+  ScheduledWorker(const ScheduledWorker&) = delete;
+  ScheduledWorker &operator=(const ScheduledWorker&) = delete;
+
+  /// start the work, the worker deletes itself after calling back
+  void Queue();
+
+  /// priority for all steps of the work, call before Queue
+  void SetPriority(WorkScheduler::Priority priority) { m_Priority = priority; }
+
+protected:
+  /**
+   * @param pool pool to run on
+   * @param key work with the same key runs in order, usually the archive
+   * @param parallelism number of steps that may run at once. Steps have to be
+   *                    thread-safe if this is more than 1
+   */
+  ScheduledWorker(const Napi::Function &callback, WorkScheduler::Pool pool,
+                  const void *key, unsigned parallelism = 1)
+    : m_Env(callback.Env())
+    , m_Callback(Napi::Persistent(callback))
+    , m_Receiver(Napi::Persistent(Napi::Object::New(callback.Env())))
+    , m_Pool(pool)
+    , m_Key(key)
+    , m_Parallelism(std::max(parallelism, 1U))
+  {}
+
+  virtual void Execute() {}
+
+  /**
+   * run one step of the work
+   * @return true if there is more work to do
+   */
+  virtual bool ExecuteStep() {
+    Execute();
+    return false;
+  }
+
+  /// called once after the last step, on the thread that ran it
+  virtual void Finish() {}
+
+  virtual void OnOK() {
+    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{});
+  }
+
+  virtual void OnError(const Napi::Error &e) {
+    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ e.Value() });
+  }
+
+  /// report an error, only the first one is kept. Thread-safe
+  void SetError(const std::string &error);
+  /// true once an error was reported. Thread-safe
+  bool failed();
+
+  /// record the time from queueing to the callback as this operation
+  void SetOperation(LatencyMetrics::Operation operation) {
+    m_Operation = operation;
+    m_Timed = true;
+  }
+
+  Napi::Env Env() const { return m_Env; }
+  Napi::FunctionReference &Callback() { return m_Callback; }
+  Napi::ObjectReference &Receiver() { return m_Receiver; }
+
+private:
+  friend class BSAddon;
+
+  void run();
+  void complete();
+
+private:
+  Napi::Env m_Env;
+  Napi::FunctionReference m_Callback;
+  Napi::ObjectReference m_Receiver;
+  WorkScheduler::Pool m_Pool;
+  WorkScheduler::Priority m_Priority{ WorkScheduler::Priority::NORMAL };
+  const void *m_Key;
+  unsigned m_Parallelism;
+  BSAddon *m_Addon{ nullptr };
+  bool m_Timed{ false };
+  LatencyMetrics::Operation m_Operation{ LatencyMetrics::Operation::LOAD };
+  std::chrono::steady_clock::time_point m_Queued;
+
+  std::mutex m_Mutex;
+  std::string m_Error;
+  unsigned m_Running{ 0 };
 };
 
-class ExtractWorker : public Napi::AsyncWorker {
+void ScheduledWorker::Queue() {
+  m_Addon = m_Env.GetInstanceData<BSAddon>();
+  m_Running = m_Parallelism;
+  m_Queued = std::chrono::steady_clock::now();
+  m_Addon->beginWork(m_Env);
+  for (unsigned i = 0; i < m_Parallelism; ++i) {
+    m_Addon->scheduler().submit(m_Pool, m_Priority, m_Key, [this]() { run(); });
+  }
+}
+
+void ScheduledWorker::SetError(const std::string &error) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (m_Error.empty()) {
+    m_Error = error;
+  }
+}
+
+bool ScheduledWorker::failed() {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return !m_Error.empty();
+}
+
+void ScheduledWorker::run() {
+  bool more = false;
+  try {
+    // once a step failed the remaining ones are skipped
+    if (!failed()) {
+      more = ExecuteStep();
+    }
+  }
+  catch (const std::exception &e) {
+    SetError(e.what());
+  }
+
+  if (more && !failed()) {
+    // back into the queue behind the work of other keys
+    m_Addon->scheduler().submit(m_Pool, m_Priority, m_Key, [this]() { run(); });
+    return;
+  }
+
+  bool last;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    last = --m_Running == 0;
+  }
+  if (last) {
+    Finish();
+    m_Addon->finishWork(this);
+  }
+}
+
+void ScheduledWorker::complete() {
+  Napi::HandleScope scope(m_Env);
+  // deleted even if the callback throws
+  std::unique_ptr<ScheduledWorker> self(this);
+  m_Addon->syncExternalMemory(m_Env);
+  if (m_Timed) {
+    LatencyMetrics::operations().record(m_Operation, std::chrono::steady_clock::now() - m_Queued);
+  }
+  if (m_Error.empty()) {
+    OnOK();
+  } else {
+    OnError(Napi::Error::New(m_Env, m_Error));
+  }
+}
+
+class ExtractWorker : public ScheduledWorker {
 public:
   ExtractWorker(std::shared_ptr<BSA::Archive> archive,
              BSA::File::Ptr file,
              const char *outputrDirectory,
              const Napi::Function &appCallback)
-    : Napi::AsyncWorker(appCallback)
+    : ScheduledWorker(appCallback, WorkScheduler::Pool::IO, archive.get())
     , m_Archive(archive)
     , m_File(file)
     , m_OutputDirectory(outputrDirectory)
-  {}
+  {
+    SetOperation(file ? LatencyMetrics::Operation::EXTRACT_FILE : LatencyMetrics::Operation::EXTRACT_ALL);
+  }
+
+  ExtractWorker(std::shared_ptr<ArchiveReader> reader,
+                uint32_t fileId,
+                const char *outputDirectory,
+                const Napi::Function &appCallback,
+                IOSchedule schedule = IOSchedule::AUTO,
+                const ManifestRequest &manifest = ManifestRequest())
+    : ScheduledWorker(appCallback, WorkScheduler::Pool::IO, reader.get())
+    , m_Reader(reader)
+    , m_FileId(fileId)
+    , m_OutputDirectory(outputDirectory)
+    , m_Schedule(schedule)
+    , m_ManifestRequest(manifest)
+  {
+    SetOperation(fileId == NO_FILE ? LatencyMetrics::Operation::EXTRACT_ALL : LatencyMetrics::Operation::EXTRACT_FILE);
+    if (manifest.format != ManifestRequest::Format::NONE) {
+      m_Manifest.reset(new ExtractionManifest(manifest.digests));
+    }
+  }
+
+  virtual bool ExecuteStep() override {
+    if ((m_Reader.get() == nullptr) || (m_FileId != NO_FILE)) {
+      Execute();
+      return false;
+    }
+
+    // full extractions go one batch at a time so they take turns with other archives
+    try {
+      if (!m_Extraction) {
+        m_Extraction.reset(new ArchiveReader::Extraction(*m_Reader, m_OutputDirectory, m_Schedule));
+        m_Extraction->setManifest(m_Manifest.get());
+      }
+      return m_Extraction->step([](int, std::string) { return true; });
+    }
+    catch (const std::exception &e) {
+      SetError(e.what());
+      return false;
+    }
+  }
+
+  virtual void Execute() override {
+    if (m_Reader.get() != nullptr) {
+      try {
+        m_Reader->extract(m_FileId, m_OutputDirectory);
+      }
+      catch (const std::exception &e) {
+        SetError(e.what());
+      }
+      return;
+    }
 
-  void Execute() {
     BSA::EErrorCode code;
     if (m_File.get() != nullptr) {
       code = m_Archive->extract(m_File, m_OutputDirectory.c_str());
@@ -75,17 +489,475 @@ public:
     }
   }
 
+  virtual void Finish() override {
+    if (m_Manifest && !failed()) {
+      try {
+        saveManifest(m_ManifestRequest, *m_Manifest, *m_Reader->index());
+      }
+      catch (const std::exception &e) {
+        SetError(e.what());
+      }
+    }
+  }
+
   virtual void OnOK() override {
-    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ Env().Null() });
+    if (m_ManifestRequest.format == ManifestRequest::Format::ARRAYS) {
+      Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{
+        Env().Null(), manifestResult(Env(), m_ManifestRequest, m_Manifest.get(), *m_Reader->index()) });
+    } else {
+      Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ Env().Null() });
+    }
   }
 
+  static constexpr uint32_t NO_FILE = UINT32_MAX;
+
 private:
   std::shared_ptr<BSA::Archive> m_Archive;
   std::shared_ptr<BSA::File> m_File;
+  std::shared_ptr<ArchiveReader> m_Reader;
+  uint32_t m_FileId{ NO_FILE };
   std::string m_OutputDirectory;
+  IOSchedule m_Schedule{ IOSchedule::AUTO };
+  std::unique_ptr<ArchiveReader::Extraction> m_Extraction;
+  ManifestRequest m_ManifestRequest;
+  std::unique_ptr<ExtractionManifest> m_Manifest;
+};
+
+/**
+ * decodes all files of a loaded archive, several batches at a time, and hands them
+ * to a js function. Files are delivered in batches through a tsfn with a bounded
+ * queue so decoding pauses while js is behind. Decoded files count against the
+ * extraction budget until js has received them. The callback is only called once
+ * all batches were delivered
+ */
+class DeliverFilesWorker : public ScheduledWorker {
+public:
+  DeliverFilesWorker(std::shared_ptr<ArchiveReader> reader,
+                     const Napi::Function &onFile,
+                     IOSchedule schedule,
+                     unsigned parallelism,
+                     const ManifestRequest &manifest,
+                     const Napi::Function &appCallback)
+    : ScheduledWorker(appCallback, WorkScheduler::Pool::IO, reader.get(), parallelism)
+    , m_Reader(reader)
+    , m_Schedule(schedule)
+    , m_ManifestRequest(manifest)
+  {
+    SetOperation(LatencyMetrics::Operation::EXTRACT_ALL);
+    m_TSFN = Napi::ThreadSafeFunction::New(appCallback.Env(), onFile, "BSAFileSink", MAX_QUEUED_BATCHES, 1);
+    if (manifest.format != ManifestRequest::Format::NONE) {
+      m_Manifest.reset(new ExtractionManifest(manifest.digests));
+    }
+  }
+
+  virtual bool ExecuteStep() override {
+    bool more = false;
+    try {
+      std::call_once(m_Init, [this]() {
+        m_Extraction.reset(new ArchiveReader::Extraction(*m_Reader,
+          [this](uint32_t file, std::vector<uint8_t> &data, MemoryBudget::Lease &lease) {
+            collect(file, data, lease);
+          }, m_Schedule));
+        m_Extraction->setManifest(m_Manifest.get());
+      });
+      more = m_Extraction->step([](int, std::string) { return true; });
+      flush();
+    }
+    catch (const std::exception &e) {
+      SetError(e.what());
+      // the files of the failed step would hold on to their budget
+      std::lock_guard<std::mutex> lock(m_BatchMutex);
+      m_Pending = Batch();
+      more = false;
+    }
+    return more;
+  }
+
+  virtual void Finish() override {
+    // batches still queued reference this worker
+    {
+      std::unique_lock<std::mutex> lock(m_BatchMutex);
+      m_Delivered.wait(lock, [this]() { return m_InFlight == 0; });
+    }
+    if (m_Manifest && !failed()) {
+      try {
+        saveManifest(m_ManifestRequest, *m_Manifest, *m_Reader->index());
+      }
+      catch (const std::exception &e) {
+        SetError(e.what());
+      }
+    }
+  }
+
+  virtual void OnOK() override {
+    m_TSFN.Release();
+    if (m_ManifestRequest.format == ManifestRequest::Format::ARRAYS) {
+      Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{
+        Env().Null(), manifestResult(Env(), m_ManifestRequest, m_Manifest.get(), *m_Reader->index()) });
+    } else {
+      Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ Env().Null() });
+    }
+  }
+
+  virtual void OnError(const Napi::Error &e) override {
+    m_TSFN.Release();
+    ScheduledWorker::OnError(e);
+  }
+
+private:
+  struct Batch {
+    std::vector<uint32_t> files;
+    std::vector<std::vector<uint8_t>> contents;
+    // returned to the budget once the batch is dropped
+    std::vector<MemoryBudget::Lease> leases;
+  };
+
+  void collect(uint32_t file, std::vector<uint8_t> &data, MemoryBudget::Lease &lease) {
+    std::lock_guard<std::mutex> lock(m_BatchMutex);
+    m_Pending.files.push_back(file);
+    m_Pending.contents.push_back(std::move(data));
+    m_Pending.leases.push_back(std::move(lease));
+  }
+
+  /**
+   * send the files decoded so far to js. Every step ends with this, a step
+   * waiting for budget held by files nobody sends would never get it back.
+   * A step covers one read batch of the archive so batches stay small
+   */
+  void flush() {
+    Batch *batch;
+    {
+      std::lock_guard<std::mutex> lock(m_BatchMutex);
+      if (m_Pending.files.empty()) {
+        return;
+      }
+      batch = new Batch(std::move(m_Pending));
+      m_Pending = Batch();
+      ++m_InFlight;
+    }
+
+    // blocks while the queue is full
+    napi_status status = m_TSFN.BlockingCall(batch, [this](Napi::Env env, Napi::Function onFile, Batch *batch) {
+      deliver(env, onFile, batch);
+    });
+    if (status != napi_ok) {
+      dropBatch(batch);
+      throw std::runtime_error("canceled");
+    }
+  }
+
+  void deliver(Napi::Env env, Napi::Function onFile, Batch *batch) {
+    // skipped once js failed or if the environment is shutting down
+    if ((env != nullptr) && !failed()) {
+      const ArchiveIndex &index = *m_Reader->index();
+      try {
+        for (size_t i = 0; i < batch->files.size(); ++i) {
+          const std::vector<uint8_t> &content = batch->contents[i];
+          // copied, not every runtime allows external buffers
+          onFile.Call({ Napi::String::New(env, index.filePath(batch->files[i])),
+                        Napi::Buffer<uint8_t>::Copy(env, content.data(), content.size()) });
+        }
+      }
+      catch (const Napi::Error &e) {
+        SetError(e.Message());
+      }
+    }
+    dropBatch(batch);
+  }
+
+  void dropBatch(Batch *batch) {
+    delete batch;
+    std::lock_guard<std::mutex> lock(m_BatchMutex);
+    --m_InFlight;
+    m_Delivered.notify_all();
+  }
+
+private:
+  static constexpr size_t MAX_QUEUED_BATCHES = 4;
+
+  std::shared_ptr<ArchiveReader> m_Reader;
+  IOSchedule m_Schedule;
+  std::once_flag m_Init;
+  std::unique_ptr<ArchiveReader::Extraction> m_Extraction;
+  ManifestRequest m_ManifestRequest;
+  std::unique_ptr<ExtractionManifest> m_Manifest;
+  Napi::ThreadSafeFunction m_TSFN;
+
+  std::mutex m_BatchMutex;
+  std::condition_variable m_Delivered;
+  Batch m_Pending;
+  size_t m_InFlight{ 0 };
+};
+
+/**
+ * reads byte ranges of files in a loaded archive, as one batch
+ */
+class ReadRangeWorker : public ScheduledWorker {
+public:
+  ReadRangeWorker(std::shared_ptr<ArchiveReader> reader,
+                  std::vector<RangeRead> ranges,
+                  bool single,
+                  const Napi::Function &appCallback)
+    : ScheduledWorker(appCallback, WorkScheduler::Pool::IO, reader.get())
+    , m_Reader(reader)
+    , m_Ranges(std::move(ranges))
+    , m_Outputs(m_Ranges.size())
+    , m_Single(single)
+  {
+    for (size_t i = 0; i < m_Ranges.size(); ++i) {
+      m_Ranges[i].output = &m_Outputs[i];
+    }
+  }
+
+  virtual void Execute() override {
+    try {
+      m_Reader->readRanges(m_Ranges.data(), m_Ranges.size());
+    }
+    catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  virtual void OnOK() override {
+    Napi::Env env = Env();
+    Napi::Value result;
+    if (m_Single) {
+      result = Napi::Buffer<uint8_t>::Copy(env, m_Outputs[0].data(), m_Outputs[0].size());
+    } else {
+      Napi::Array buffers = Napi::Array::New(env, m_Outputs.size());
+      for (size_t i = 0; i < m_Outputs.size(); ++i) {
+        buffers.Set(static_cast<uint32_t>(i),
+                    Napi::Buffer<uint8_t>::Copy(env, m_Outputs[i].data(), m_Outputs[i].size()));
+      }
+      result = buffers;
+    }
+    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ env.Null(), result });
+  }
+
+private:
+  std::shared_ptr<ArchiveReader> m_Reader;
+  std::vector<RangeRead> m_Ranges;
+  std::vector<std::vector<uint8_t>> m_Outputs;
+  bool m_Single;
+};
+
+/**
+ * reads the dds headers of all textures in a list of loaded archives, one archive
+ * per step with up to parallelism archives at a time
+ */
+class ScanTexturesWorker : public ScheduledWorker {
+public:
+  ScanTexturesWorker(std::vector<std::shared_ptr<ArchiveReader>> archives,
+                     unsigned parallelism,
+                     const Napi::Function &appCallback)
+    : ScheduledWorker(appCallback, WorkScheduler::Pool::IO, this, parallelism)
+    , m_Archives(archives)
+    , m_Scan(std::move(archives))
+  {}
+
+  virtual bool ExecuteStep() override {
+    return m_Scan.step();
+  }
+
+  virtual void OnOK() override {
+    Napi::Env env = Env();
+    m_Headers = m_Scan.result();
+    Napi::Array paths = Napi::Array::New(env, m_Headers.size());
+    Napi::Uint32Array headers = Napi::Uint32Array::New(env, m_Headers.size() * SCAN_FIELDS);
+    uint32_t *fields = headers.Data();
+    for (size_t i = 0; i < m_Headers.size(); ++i) {
+      const TextureHeader &header = m_Headers[i];
+      paths.Set(static_cast<uint32_t>(i), m_Archives[header.archive]->index()->filePath(header.file));
+      uint32_t *item = fields + i * SCAN_FIELDS;
+      item[0] = header.archive;
+      item[1] = header.width;
+      item[2] = header.height;
+      item[3] = header.mipCount;
+      item[4] = header.fourCC;
+      item[5] = header.dxgiFormat;
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("paths", paths);
+    result.Set("headers", headers);
+    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ env.Null(), result });
+  }
+
+private:
+  // archive, width, height, mip count, fourCC, dxgi format
+  static constexpr size_t SCAN_FIELDS = 6;
+
+  std::vector<std::shared_ptr<ArchiveReader>> m_Archives;
+  TextureScan m_Scan;
+  std::vector<TextureHeader> m_Headers;
+};
+
+/**
+ * extracts a list of loaded archives as one deployment on all io workers, see
+ * Deployment. Calls back with the result of every archive, a failing archive
+ * doesn't stop the others. Progress is sent to js at most every PROGRESS_INTERVAL
+ * and skipped while js hasn't picked up the previous report. If onProgress throws
+ * the deployment is canceled and the callback receives the error
+ */
+class DeployWorker : public ScheduledWorker {
+public:
+  DeployWorker(std::shared_ptr<Deployment> deployment,
+               unsigned parallelism,
+               const Napi::Value &onProgress,
+               const Napi::Function &appCallback)
+    : ScheduledWorker(appCallback, WorkScheduler::Pool::IO, this, parallelism)
+    , m_Deployment(deployment)
+  {
+    if (onProgress.IsFunction()) {
+      m_TSFN = Napi::ThreadSafeFunction::New(appCallback.Env(), onProgress.As<Napi::Function>(),
+                                             "BSADeployProgress", 1, 1);
+      m_Reporting = true;
+    }
+  }
+
+  virtual bool ExecuteStep() override {
+    bool more = m_Deployment->step();
+    reportProgress();
+    return more;
+  }
+
+  virtual void Finish() override {
+    // reports still queued reference this worker
+    std::unique_lock<std::mutex> lock(m_ReportMutex);
+    m_Reported.wait(lock, [this]() { return m_ReportsInFlight == 0; });
+  }
+
+  virtual void OnOK() override {
+    releaseProgress();
+    Napi::Env env = Env();
+    std::vector<DeployResult> results = m_Deployment->results();
+    Napi::Array list = Napi::Array::New(env, results.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+      Napi::Object item = Napi::Object::New(env);
+      item.Set("files", results[i].files);
+      item.Set("size", static_cast<double>(results[i].size));
+      item.Set("error", results[i].error.empty()
+        ? env.Null()
+        : Napi::Value(Napi::Error::New(env, results[i].error).Value()));
+      list.Set(static_cast<uint32_t>(i), item);
+    }
+    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ env.Null(), list });
+  }
+
+  virtual void OnError(const Napi::Error &e) override {
+    releaseProgress();
+    ScheduledWorker::OnError(e);
+  }
+
+private:
+  void reportProgress() {
+    if (!m_Reporting || !m_Deployment->planned()) {
+      return;
+    }
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t last = m_LastReport.load();
+    if ((now - last < PROGRESS_INTERVAL) || !m_LastReport.compare_exchange_strong(last, now)) {
+      return;
+    }
+
+    DeployProgress *progress = new DeployProgress(m_Deployment->progress());
+    {
+      std::lock_guard<std::mutex> lock(m_ReportMutex);
+      ++m_ReportsInFlight;
+    }
+    napi_status status = m_TSFN.NonBlockingCall(progress,
+      [this](Napi::Env env, Napi::Function onProgress, DeployProgress *progress) {
+        deliverProgress(env, onProgress, progress);
+      });
+    if (status != napi_ok) {
+      dropProgress(progress);
+    }
+  }
+
+  void deliverProgress(Napi::Env env, Napi::Function onProgress, DeployProgress *progress) {
+    // skipped once js failed or if the environment is shutting down
+    if ((env != nullptr) && !failed()) {
+      Napi::Object item = Napi::Object::New(env);
+      item.Set("files", progress->files);
+      item.Set("totalFiles", progress->totalFiles);
+      item.Set("size", static_cast<double>(progress->size));
+      item.Set("totalSize", static_cast<double>(progress->totalSize));
+      try {
+        onProgress.Call({ item });
+      }
+      catch (const Napi::Error &e) {
+        SetError(e.Message());
+        m_Deployment->cancel();
+      }
+    }
+    dropProgress(progress);
+  }
+
+  void dropProgress(DeployProgress *progress) {
+    delete progress;
+    std::lock_guard<std::mutex> lock(m_ReportMutex);
+    --m_ReportsInFlight;
+    m_Reported.notify_all();
+  }
+
+  void releaseProgress() {
+    if (m_Reporting) {
+      m_TSFN.Release();
+    }
+  }
+
+private:
+  static constexpr int64_t PROGRESS_INTERVAL = 100;
+
+  std::shared_ptr<Deployment> m_Deployment;
+  bool m_Reporting{ false };
+  Napi::ThreadSafeFunction m_TSFN;
+  std::atomic<int64_t> m_LastReport{ 0 };
+
+  std::mutex m_ReportMutex;
+  std::condition_variable m_Reported;
+  size_t m_ReportsInFlight{ 0 };
+};
+
+/**
+ * parses an archive, calls back with (null, archive) or with the error message
+ */
+class LoadWorker : public ScheduledWorker {
+public:
+  LoadWorker(const Napi::Object &archive,
+             std::function<void()> load,
+             const Napi::Function &appCallback)
+    : ScheduledWorker(appCallback, WorkScheduler::Pool::CPU, this)
+    , m_Archive(Napi::Persistent(archive))
+    , m_Load(std::move(load))
+  {
+    SetOperation(LatencyMetrics::Operation::LOAD);
+  }
+
+  virtual void Execute() override {
+    try {
+      m_Load();
+    }
+    catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  virtual void OnOK() override {
+    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ Env().Null(), m_Archive.Value() });
+  }
+
+  virtual void OnError(const Napi::Error &e) override {
+    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ Napi::String::New(Env(), e.Message()) });
+  }
+
+private:
+  Napi::ObjectReference m_Archive;
+  std::function<void()> m_Load;
 };
 
-class BSAFile : public Napi::ObjectWrap<BSAFile> {
+class BSAFile : public Napi::ObjectWrap<BSAFile>, public CountedObject<MemoryCategory::WRAPPERS> {
 public:
   static Napi::FunctionReference Init(Napi::Env env, Napi::Object exports) {
     Napi::Function func = DefineClass(env, "BSAFile", {
@@ -102,21 +974,17 @@ public:
     return Napi::Persistent(func);
   }
 
+  // views are not pinned, otherwise the archive index they reference could
+  // never be released
   BSAFile(const Napi::CallbackInfo& info)
     : Napi::ObjectWrap<BSAFile>(info)
   {
-    Ref();
   }
 
   BSAFile(const Napi::CallbackInfo &info, std::shared_ptr<BSA::File> file)
     : Napi::ObjectWrap<BSAFile>(info)
     , m_File(file)
   {
-    Ref();
-  }
-
-  ~BSAFile() {
-    Unref();
   }
 
   static Napi::Object CreateNewItem(Napi::Env env) {
@@ -129,17 +997,34 @@ public:
     m_File = file;
   }
 
+  // files of loaded archives are views into the archive index
+  void setView(const std::shared_ptr<const ArchiveIndex> &index, uint32_t id)
+  {
+    m_Index = index;
+    m_Id = id;
+  }
+
   BSA::File::Ptr getWrappee() const { return m_File; }
+  const std::shared_ptr<const ArchiveIndex> &getIndex() const { return m_Index; }
+  uint32_t getId() const { return m_Id; }
 
-  Napi::Value getName(const Napi::CallbackInfo &info) { return Napi::String::New(info.Env(), m_File->getName()); }
-  Napi::Value getFilePath(const Napi::CallbackInfo &info) { return Napi::String::New(info.Env(), m_File->getFilePath()); }
-  Napi::Value getFileSize(const Napi::CallbackInfo &info) { return Napi::Number::New(info.Env(), m_File->getFileSize()); }
+  Napi::Value getName(const Napi::CallbackInfo &info) {
+    return Napi::String::New(info.Env(), m_Index ? m_Index->fileName(m_Id) : m_File->getName());
+  }
+  Napi::Value getFilePath(const Napi::CallbackInfo &info) {
+    return Napi::String::New(info.Env(), m_Index ? m_Index->filePath(m_Id) : m_File->getFilePath());
+  }
+  Napi::Value getFileSize(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_Index ? m_Index->fileSize(m_Id) : m_File->getFileSize());
+  }
 
 private:
   BSA::File::Ptr m_File;
+  std::shared_ptr<const ArchiveIndex> m_Index;
+  uint32_t m_Id{ 0 };
 };
 
-class BSAFolder: public Napi::ObjectWrap<BSAFolder> {
+class BSAFolder: public Napi::ObjectWrap<BSAFolder>, public CountedObject<MemoryCategory::WRAPPERS> {
 public:
   static Napi::FunctionReference Init(Napi::Env env, Napi::Object exports) {
     Napi::Function func = DefineClass(env, "BSAFolder", {
@@ -163,21 +1048,17 @@ public:
     return Napi::Persistent(func);
   }
 
+  // views are not pinned, otherwise the archive index they reference could
+  // never be released
   BSAFolder(const Napi::CallbackInfo& info)
     : Napi::ObjectWrap<BSAFolder>(info)
   {
-    Ref();
   }
 
   BSAFolder(const Napi::CallbackInfo &info, std::shared_ptr<BSA::Folder> folder)
     : Napi::ObjectWrap<BSAFolder>(info)
     , m_Folder(folder)
   {
-    Ref();
-  }
-
-  virtual ~BSAFolder() {
-    Unref();
   }
 
   static Napi::Object CreateNewItem(Napi::Env env) {
@@ -190,30 +1071,70 @@ public:
     m_Folder = folder;
   }
 
-  Napi::Value getName(const Napi::CallbackInfo &info) { return Napi::String::New(info.Env(), m_Folder->getName()); }
-  Napi::Value getFullPath(const Napi::CallbackInfo &info) { return Napi::String::New(info.Env(), m_Folder->getFullPath()); }
-  Napi::Value getNumSubFolders(const Napi::CallbackInfo &info) { return Napi::Number::New(info.Env(), m_Folder->getNumSubFolders()); }
+  // folders of loaded archives are views into the archive index
+  void setView(const std::shared_ptr<const ArchiveIndex> &index, uint32_t id)
+  {
+    m_Index = index;
+    m_Id = id;
+  }
+
+  Napi::Value getName(const Napi::CallbackInfo &info) {
+    return Napi::String::New(info.Env(), m_Index ? m_Index->folderName(m_Id) : m_Folder->getName());
+  }
+  Napi::Value getFullPath(const Napi::CallbackInfo &info) {
+    return Napi::String::New(info.Env(), m_Index ? m_Index->folderPath(m_Id) : m_Folder->getFullPath());
+  }
+  Napi::Value getNumSubFolders(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_Index ? m_Index->numSubFolders(m_Id) : m_Folder->getNumSubFolders());
+  }
   Napi::Value getSubFolder(const Napi::CallbackInfo &info) {
+    LatencyMetrics::Timer timer(LatencyMetrics::Operation::NAVIGATE);
     int32_t idx = info[0].ToNumber().Int32Value();
     Napi::Object result = CreateNewItem(info.Env());
-    BSAFolder::Unwrap(result)->setWrappee(m_Folder->getSubFolder(idx));
+    if (m_Index) {
+      if ((idx < 0) || (static_cast<uint32_t>(idx) >= m_Index->numSubFolders(m_Id))) {
+        throw Napi::RangeError::New(info.Env(), "invalid folder index");
+      }
+      BSAFolder::Unwrap(result)->setView(m_Index, m_Index->subFolder(m_Id, idx));
+    } else {
+      BSAFolder::Unwrap(result)->setWrappee(m_Folder->getSubFolder(idx));
+    }
     return result;
   }
-  Napi::Value getNumFiles(const Napi::CallbackInfo &info) { return Napi::Number::New(info.Env(), m_Folder->getNumFiles()); }
-  Napi::Value countFiles(const Napi::CallbackInfo &info) { return Napi::Number::New(info.Env(), m_Folder->countFiles()); }
+  Napi::Value getNumFiles(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_Index ? m_Index->numFolderFiles(m_Id) : m_Folder->getNumFiles());
+  }
+  Napi::Value countFiles(const Napi::CallbackInfo &info) {
+    return Napi::Number::New(info.Env(), m_Index ? m_Index->countFiles(m_Id) : m_Folder->countFiles());
+  }
   Napi::Value getFile(const Napi::CallbackInfo &info) {
+    LatencyMetrics::Timer timer(LatencyMetrics::Operation::NAVIGATE);
     int32_t idx = info[0].ToNumber().Int32Value();
     Napi::Object result = BSAFile::CreateNewItem(info.Env());
-    BSAFile::Unwrap(result)->setWrappee(m_Folder->getFile(idx));
+    if (m_Index) {
+      if ((idx < 0) || (static_cast<uint32_t>(idx) >= m_Index->numFolderFiles(m_Id))) {
+        throw Napi::RangeError::New(info.Env(), "invalid file index");
+      }
+      BSAFile::Unwrap(result)->setView(m_Index, m_Index->folderFile(m_Id, idx));
+    } else {
+      BSAFile::Unwrap(result)->setWrappee(m_Folder->getFile(idx));
+    }
     return result;
   }
   Napi::Value addFile(const Napi::CallbackInfo &info) {
+    if (m_Index) {
+      throw Napi::Error::New(info.Env(), "archive is read-only");
+    }
     BSAFile *file = BSAFile::Unwrap(info[0].ToObject());
     m_Folder->addFile(file->getWrappee());
     return info.Env().Undefined();
   }
   Napi::Value addFolder(const Napi::CallbackInfo &info) {
-    Napi::String folderName = info[0].ToString();
+    if (m_Index) {
+      throw Napi::Error::New(info.Env(), "archive is read-only");
+    }
+    std::string folderName = info[0].ToString();
+    normalizePath(folderName);
     Napi::Object result = CreateNewItem(info.Env());
     BSA::Folder::Ptr newFolder = m_Folder->addFolder(folderName);
     BSAFolder::Unwrap(result)->setWrappee(newFolder);
@@ -222,9 +1143,73 @@ public:
 
 private:
   std::shared_ptr<BSA::Folder> m_Folder;
+  std::shared_ptr<const ArchiveIndex> m_Index;
+  uint32_t m_Id{ 0 };
+};
+
+/**
+ * searches the paths of a loaded archive. The first search builds the lookup
+ * structure, which sorts all paths of the archive, so it doesn't run on the main thread
+ */
+class FindWorker : public ScheduledWorker {
+public:
+  FindWorker(std::shared_ptr<ArchiveReader> reader,
+             SearchMode mode,
+             const std::string &query,
+             uint32_t cursor,
+             uint32_t limit,
+             const Napi::Function &appCallback)
+    : ScheduledWorker(appCallback, WorkScheduler::Pool::CPU, reader.get())
+    , m_Reader(reader)
+    , m_Mode(mode)
+    , m_Query(query)
+    , m_Cursor(cursor)
+    , m_Limit(limit)
+  {}
+
+  virtual void Execute() override {
+    try {
+      m_Page = m_Reader->index()->pathIndex().search(m_Mode, m_Query, m_Cursor, m_Limit);
+    }
+    catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  virtual void OnOK() override {
+    Napi::Env env = Env();
+    // the first search builds the lookup structure
+    env.GetInstanceData<BSAddon>()->syncExternalMemory(env);
+
+    const std::shared_ptr<const ArchiveIndex> &index = m_Reader->index();
+    Napi::Array files = Napi::Array::New(env, m_Page.files.size());
+    for (uint32_t i = 0; i < m_Page.files.size(); ++i) {
+      Napi::Object file = BSAFile::CreateNewItem(env);
+      BSAFile::Unwrap(file)->setView(index, m_Page.files[i]);
+      files.Set(i, file);
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("files", files);
+    result.Set("next", m_Page.next == SearchPage::END
+      ? env.Null()
+      : Napi::Number::New(env, m_Page.next));
+    if (m_Page.total != SearchPage::END) {
+      result.Set("total", Napi::Number::New(env, m_Page.total));
+    }
+    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ env.Null(), result });
+  }
+
+private:
+  std::shared_ptr<ArchiveReader> m_Reader;
+  SearchMode m_Mode;
+  std::string m_Query;
+  uint32_t m_Cursor;
+  uint32_t m_Limit;
+  SearchPage m_Page;
 };
 
-class BSArchive: public Napi::ObjectWrap<BSArchive> {
+class BSArchive: public Napi::ObjectWrap<BSArchive>, public CountedObject<MemoryCategory::WRAPPERS> {
 public:
   static Napi::FunctionReference Init(Napi::Env env, Napi::Object exports) {
     Napi::Function func = DefineClass(env, "BSArchive", {
@@ -236,7 +1221,12 @@ public:
       InstanceMethod("write", &BSArchive::write),
       InstanceMethod("extractFile", &BSArchive::extractFile),
       InstanceMethod("extractAll", &BSArchive::extractAll),
+      InstanceMethod("readRange", &BSArchive::readRange),
+      InstanceMethod("readRanges", &BSArchive::readRanges),
       InstanceMethod("closeArchive", &BSArchive::closeArchive),
+      InstanceMethod("findFiles", &BSArchive::findFiles),
+      InstanceMethod("exportIndex", &BSArchive::exportIndex),
+      InstanceMethod("publishIndex", &BSArchive::publishIndex),
     });
     exports.Set("BSArchive", func);
     return Napi::Persistent(func);
@@ -263,43 +1253,66 @@ public:
   }
 
   void readAsync(const Napi::CallbackInfo& info, const std::string& filePath, bool testHashes, const Napi::Function& cb) {
-    const Napi::Env env = info.Env();
-    std::thread* loadThread;
+    loadAsync(info, [this, filePath, testHashes]() { read(filePath.c_str(), testHashes); }, cb);
+  }
 
-    m_ThreadCB = Napi::ThreadSafeFunction::New(info.Env(), cb,
-      "AsyncLoadCB", 0, 1, [loadThread](Napi::Env) {
-      loadThread->join();
-      delete loadThread;
-    });
+  /**
+   * parse an archive held in a Buffer. The data is used in place, the buffer is
+   * referenced until the archive object gets destroyed
+   */
+  void readBufferAsync(const Napi::CallbackInfo& info, const Napi::Buffer<uint8_t>& buffer, bool testHashes, const Napi::Function& cb) {
+    m_Buffer = Napi::Persistent(buffer);
+    readSourceAsync(info, makeMemoryArchiveSource(buffer.Data(), buffer.Length()), testHashes, cb);
+  }
 
+  void readSourceAsync(const Napi::CallbackInfo& info, std::unique_ptr<ArchiveSource> source, bool testHashes, const Napi::Function& cb) {
+    auto holder = std::make_shared<std::unique_ptr<ArchiveSource>>(std::move(source));
+    loadAsync(info, [this, holder, testHashes]() {
+      m_Reader = ArchiveReader::open(std::move(*holder), testHashes);
+    }, cb);
+  }
 
-    loadThread = new std::thread{ [this, env, filePath, testHashes]() {
-      auto callback = [](Napi::Env env, Napi::Function jsCallback, BSArchive* result) {
-        jsCallback.Call({ env.Null(), result->Value() });
-      };
+  /// reader of a loaded archive, empty for archives being created
+  const std::shared_ptr<ArchiveReader> &reader() const { return m_Reader; }
 
-      auto callbackError = [](Napi::Env env, Napi::Function jsCallback, std::string* err = nullptr) {
-        jsCallback.Call({Napi::String::New(env, err->c_str())});
-      };
+  void attach(const std::shared_ptr<const ArchiveIndex> &index, const std::string &fileName) {
+    m_Reader = ArchiveReader::attach(index, fileName);
+  }
 
-      try {
-        read(filePath.c_str(), testHashes);
-        m_ThreadCB.Acquire();
-        m_ThreadCB.BlockingCall(this, callback);
-      }
-      catch (const std::exception& e) {
-        std::string* err = new std::string{ e.what() };
-        m_ThreadCB.Acquire();
-        m_ThreadCB.BlockingCall(err, callbackError);
-      }
+private:
+  /// id of a file view, which has to belong to the loaded archive
+  uint32_t loadedFileId(Napi::Env env, const Napi::Value &value) {
+    BSAFile *file = BSAFile::Unwrap(value.ToObject());
+    if (file->getIndex() != m_Reader->index()) {
+      throw Napi::Error::New(env, "file not found");
+    }
+    return file->getId();
+  }
 
-      m_ThreadCB.Release();
-    } };
+  RangeRead readRangeArgs(Napi::Env env, const Napi::Value &file, const Napi::Value &offset, const Napi::Value &length) {
+    double offsetValue = offset.ToNumber().DoubleValue();
+    double lengthValue = length.ToNumber().DoubleValue();
+    if (!(offsetValue >= 0) || !(lengthValue >= 0) || (lengthValue > UINT32_MAX)) {
+      throw Napi::RangeError::New(env, "invalid range");
+    }
+    return RangeRead{ loadedFileId(env, file), static_cast<uint64_t>(offsetValue),
+                      static_cast<uint32_t>(lengthValue), nullptr };
+  }
+
+  void loadAsync(const Napi::CallbackInfo& info, const std::function<void()> &load, const Napi::Function& cb) {
+    LoadWorker *worker = new LoadWorker(Value(), load, cb);
+    // all load functions take (source, testHashes, callback, options)
+    worker->SetPriority(priorityOption(info.Env(), info[3]));
+    worker->Queue();
   }
 
   Napi::Value createFile(const Napi::CallbackInfo &info) {
-    Napi::String fileName = info[0].ToString();
-    Napi::String sourcePath = info[1].ToString();
+    if (m_Reader) {
+      throw Napi::Error::New(info.Env(), "archive is read-only");
+    }
+    std::string fileName = info[0].ToString();
+    normalizePath(fileName);
+    std::string sourcePath = info[1].ToString();
     Napi::Boolean compressed = info[2].ToBoolean();
     BSA::File::Ptr file = m_Wrapped->createFile(fileName, sourcePath, compressed);
     Napi::Object result = BSAFile::CreateNewItem(info.Env());
@@ -308,6 +1321,10 @@ public:
   }
 
   Napi::Value write(const Napi::CallbackInfo &info) {
+    if (m_Reader) {
+      throw Napi::Error::New(info.Env(), "archive is read-only");
+    }
+    LatencyMetrics::Timer timer(LatencyMetrics::Operation::WRITE);
     BSA::EErrorCode err = m_Wrapped->write(m_Name.c_str());
     if (err != BSA::ERROR_NONE) {
       throw std::runtime_error(convertErrorCode(err));
@@ -316,14 +1333,25 @@ public:
   }
 
   Napi::Value getRoot(const Napi::CallbackInfo &info) {
-    BSA::Folder::Ptr root = m_Wrapped->getRoot();
+    LatencyMetrics::Timer timer(LatencyMetrics::Operation::NAVIGATE);
     Napi::Object result = BSAFolder::CreateNewItem(info.Env());
-    BSAFolder::Unwrap(result)->setWrappee(root);
+    if (m_Reader) {
+      BSAFolder::Unwrap(result)->setView(m_Reader->index(), 0);
+    } else {
+      BSAFolder::Unwrap(result)->setWrappee(m_Wrapped->getRoot());
+    }
 
     return result;
   }
 
   Napi::Value getType(const Napi::CallbackInfo& info) {
+    if (m_Reader) {
+      switch (m_Reader->index()->version()) {
+        case ArchiveIndex::VERSION_OBLIVION: return Napi::String::From(info.Env(), "oblivion");
+        case ArchiveIndex::VERSION_SKYRIM:   return Napi::String::From(info.Env(), "skyrim");
+        default: return info.Env().Null();
+      }
+    }
     switch (m_Wrapped->getType()) {
       case BSA::TYPE_OBLIVION: return Napi::String::From(info.Env(), "oblivion");
       case BSA::TYPE_SKYRIM:   return Napi::String::From(info.Env(), "skyrim");
@@ -333,56 +1361,658 @@ public:
   }
 
   Napi::Value extractFile(const Napi::CallbackInfo &info) {
-    auto worker = new ExtractWorker(m_Wrapped,
-      BSAFile::Unwrap(info[0].ToObject())->getWrappee(),
-      info[1].ToString().Utf8Value().c_str(),
-      info[2].As<Napi::Function>());
+    BSAFile *file = BSAFile::Unwrap(info[0].ToObject());
+    ExtractWorker *worker;
+    if (m_Reader) {
+      worker = new ExtractWorker(m_Reader,
+        loadedFileId(info.Env(), info[0]),
+        info[1].ToString().Utf8Value().c_str(),
+        info[2].As<Napi::Function>());
+    } else {
+      worker = new ExtractWorker(m_Wrapped,
+        file->getWrappee(),
+        info[1].ToString().Utf8Value().c_str(),
+        info[2].As<Napi::Function>());
+    }
+
+    worker->SetPriority(priorityOption(info.Env(), info[3]));
+    worker->Queue();
+    return info.Env().Undefined();
+  }
+
+  Napi::Value readRange(const Napi::CallbackInfo &info) {
+    if (!m_Reader) {
+      throw Napi::Error::New(info.Env(), "archive not loaded");
+    }
+    std::vector<RangeRead> ranges{ readRangeArgs(info.Env(), info[0], info[1], info[2]) };
+    ReadRangeWorker *worker = new ReadRangeWorker(m_Reader, std::move(ranges), true, info[3].As<Napi::Function>());
+    worker->SetPriority(priorityOption(info.Env(), info[4]));
+    worker->Queue();
+    return info.Env().Undefined();
+  }
 
+  Napi::Value readRanges(const Napi::CallbackInfo &info) {
+    if (!m_Reader) {
+      throw Napi::Error::New(info.Env(), "archive not loaded");
+    }
+    Napi::Array list = info[0].As<Napi::Array>();
+    std::vector<RangeRead> ranges;
+    ranges.reserve(list.Length());
+    for (uint32_t i = 0; i < list.Length(); ++i) {
+      Napi::Object item = list.Get(i).ToObject();
+      ranges.push_back(readRangeArgs(info.Env(), item.Get("file"), item.Get("offset"), item.Get("length")));
+    }
+    ReadRangeWorker *worker = new ReadRangeWorker(m_Reader, std::move(ranges), false, info[1].As<Napi::Function>());
+    worker->SetPriority(priorityOption(info.Env(), info[2]));
     worker->Queue();
     return info.Env().Undefined();
   }
 
   Napi::Value closeArchive(const Napi::CallbackInfo &info) {
-    if (m_Wrapped->isOpen()) {
+    if (m_Reader) {
+      m_Reader->close();
+    } else if (m_Wrapped->isOpen()) {
       m_Wrapped->close();
     }
     return info.Env().Undefined();
   }
 
   Napi::Value extractAll(const Napi::CallbackInfo &info) {
-    std::string outputDirectory = info[0].ToString();
     Napi::Function callback = info[1].As<Napi::Function>();
 
-    auto worker = new ExtractWorker(m_Wrapped,
-      std::shared_ptr<BSA::File>(),
-      outputDirectory.c_str(),
-      callback);
+    IOSchedule schedule = scheduleOption(info.Env(), info[2]);
+    WorkScheduler::Priority priority = priorityOption(info.Env(), info[2]);
+    ManifestRequest manifest = manifestOption(info.Env(), info[2]);
+    if ((manifest.format != ManifestRequest::Format::NONE) && !m_Reader) {
+      throw Napi::Error::New(info.Env(), "manifest requires a loaded archive");
+    }
+
+    // files handed to a js function instead of being written to disk
+    if (info[0].IsObject() && info[0].ToObject().Get("onFile").IsFunction()) {
+      if (!m_Reader) {
+        throw Napi::Error::New(info.Env(), "archive not loaded");
+      }
+      // workers wait while js is behind, half of them stay free for other archives
+      BSAddon *addon = info.Env().GetInstanceData<BSAddon>();
+      unsigned parallelism = std::max(addon->scheduler().workers(WorkScheduler::Pool::IO) / 2, 1U);
+      DeliverFilesWorker *worker = new DeliverFilesWorker(m_Reader,
+        info[0].ToObject().Get("onFile").As<Napi::Function>(), schedule, parallelism, manifest, callback);
+      worker->SetPriority(priority);
+      worker->Queue();
+      return info.Env().Undefined();
+    }
+
+    std::string outputDirectory = info[0].ToString();
+    // archives created through bsatk extract in their own order
+    ExtractWorker *worker = m_Reader
+      ? new ExtractWorker(m_Reader, ExtractWorker::NO_FILE, outputDirectory.c_str(), callback, schedule, manifest)
+      : new ExtractWorker(m_Wrapped, std::shared_ptr<BSA::File>(), outputDirectory.c_str(), callback);
 
+    worker->SetPriority(priority);
     worker->Queue();
     return info.Env().Undefined();
   }
 
-private:
-  void read(const char *fileName, bool testHashes) {
-    BSA::EErrorCode err = m_Wrapped->read(toWC(fileName, CodePage::UTF8, strlen(fileName)).c_str(), testHashes);
-    if (err != BSA::ERROR_NONE) {
-      throw std::runtime_error(convertErrorCode(err));
+  Napi::Value findFiles(const Napi::CallbackInfo &info) {
+    if (!m_Reader) {
+      throw Napi::Error::New(info.Env(), "archive not loaded");
+    }
+
+    std::string query = info[0].ToString();
+    Napi::Function callback = info[1].As<Napi::Function>();
+    SearchMode mode = SearchMode::PREFIX;
+    uint32_t cursor = 0;
+    uint32_t limit = UINT32_MAX;
+    if (info[2].IsObject()) {
+      Napi::Object options = info[2].ToObject();
+      if (options.Has("mode")) {
+        mode = searchModeOption(info.Env(), options.Get("mode"));
+      }
+      if (options.Has("cursor") && !options.Get("cursor").IsNull()) {
+        cursor = options.Get("cursor").ToNumber().Uint32Value();
+      }
+      if (options.Has("limit")) {
+        limit = std::max(options.Get("limit").ToNumber().Uint32Value(), 1U);
+      }
     }
+
+    FindWorker *worker = new FindWorker(m_Reader, mode, query, cursor, limit, callback);
+    worker->SetPriority(priorityOption(info.Env(), info[2]));
+    worker->Queue();
+    return info.Env().Undefined();
+  }
+
+  Napi::Value exportIndex(const Napi::CallbackInfo &info) {
+    if (!m_Reader) {
+      throw Napi::Error::New(info.Env(), "archive not loaded");
+    }
+    if (m_Reader->fileName().empty()) {
+      throw Napi::Error::New(info.Env(), "archive isn't backed by a file");
+    }
+    uint32_t handle = IndexRegistry::publish(m_Reader->index(), m_Reader->fileName());
+    return Napi::Number::New(info.Env(), handle);
+  }
+
+  Napi::Value publishIndex(const Napi::CallbackInfo &info) {
+    if (!m_Reader) {
+      throw Napi::Error::New(info.Env(), "archive not loaded");
+    }
+    if (m_Reader->fileName().empty()) {
+      throw Napi::Error::New(info.Env(), "archive isn't backed by a file");
+    }
+    try {
+      IndexRegistry::publishShared(info[0].ToString(), *m_Reader->index(), m_Reader->fileName());
+    }
+    catch (const std::exception &e) {
+      throw Napi::Error::New(info.Env(), e.what());
+    }
+    return info.Env().Undefined();
+  }
+
+  void read(const char *fileName, bool testHashes) {
+    m_Reader = ArchiveReader::open(fileName, testHashes);
   }
 private:
   std::string m_Name;
+  // archives being created are built through bsatk, loaded archives are
+  // read through the flat index
   std::shared_ptr<BSA::Archive> m_Wrapped;
-  Napi::ThreadSafeFunction m_ThreadCB;
+  std::shared_ptr<ArchiveReader> m_Reader;
+  // archives are never garbage collected while in use (see Ref in the constructor)
+  // so the buffer outlives any extraction still running
+  Napi::Reference<Napi::Buffer<uint8_t>> m_Buffer;
+};
+
+/**
+ * calls a js function from a worker thread and blocks until the js side invokes the
+ * completion callback that gets passed as the last argument.
+ * The call object is shared with the completion callback so that calling it late,
+ * or more than once, is harmless
+ */
+class BlockingJSCall {
+public:
+  typedef std::function<std::vector<napi_value>(Napi::Env)> ArgsFunc;
+  typedef std::function<void(const Napi::CallbackInfo&)> ResultFunc;
+
+  static void call(const Napi::ThreadSafeFunction &tsfn,
+                   const Napi::ObjectReference &target, const char *method,
+                   const ArgsFunc &makeArgs, const ResultFunc &onResult) {
+    std::shared_ptr<BlockingJSCall> call(new BlockingJSCall());
+    call->m_Target = &target;
+    call->m_Method = method;
+    call->m_MakeArgs = makeArgs;
+    call->m_OnResult = onResult;
+
+    // the tsfn takes ownership of one reference until its callback ran
+    auto *data = new std::shared_ptr<BlockingJSCall>(call);
+    if (tsfn.BlockingCall(data, &BlockingJSCall::invoke) != napi_ok) {
+      delete data;
+      throw std::runtime_error("canceled");
+    }
+
+    std::unique_lock<std::mutex> lock(call->m_Mutex);
+    call->m_Signal.wait(lock, [call]() { return call->m_Done; });
+    if (!call->m_Error.empty()) {
+      throw std::runtime_error(call->m_Error);
+    }
+  }
+
+private:
+  static void invoke(Napi::Env env, Napi::Function, std::shared_ptr<BlockingJSCall> *data) {
+    std::shared_ptr<BlockingJSCall> call(*data);
+    delete data;
+
+    try {
+      Napi::Function done = Napi::Function::New(env, [call](const Napi::CallbackInfo &info) {
+        std::string error;
+        if ((info.Length() > 0) && !info[0].IsUndefined() && !info[0].IsNull()) {
+          error = info[0].ToString();
+        } else {
+          try {
+            call->m_OnResult(info);
+          }
+          catch (const std::exception &e) {
+            error = e.what();
+          }
+        }
+        call->finish(error);
+      });
+
+      Napi::Object target = call->m_Target->Value();
+      std::vector<napi_value> args = call->m_MakeArgs(env);
+      args.push_back(done);
+      target.Get(call->m_Method).As<Napi::Function>().Call(target, args);
+    }
+    catch (const std::exception &e) {
+      call->finish(e.what());
+    }
+  }
+
+  void finish(const std::string &error) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Done) {
+      return;
+    }
+    m_Error = error;
+    m_Done = true;
+    m_Signal.notify_all();
+  }
+
+private:
+  const Napi::ObjectReference *m_Target{ nullptr };
+  const char *m_Method{ nullptr };
+  ArgsFunc m_MakeArgs;
+  ResultFunc m_OnResult;
+
+  std::mutex m_Mutex;
+  std::condition_variable m_Signal;
+  bool m_Done{ false };
+  std::string m_Error;
+};
+
+/**
+ * writer source that pulls data from a js object with a
+ * read(offset, length, callback(err, buffer)) method
+ */
+class JSPullSource : public WriterSource {
+public:
+  JSPullSource(const Napi::ThreadSafeFunction &tsfn, const Napi::ObjectReference &source, uint64_t size)
+    : m_TSFN(tsfn), m_Source(source), m_Size(size)
+  {}
+
+  virtual uint64_t size() const override { return m_Size; }
+
+  virtual size_t read(uint8_t *buffer, size_t length) override {
+    size_t count = 0;
+    uint64_t offset = m_Offset;
+    BlockingJSCall::call(m_TSFN, m_Source, "read",
+      [offset, length](Napi::Env env) {
+        return std::vector<napi_value>{
+          Napi::Number::New(env, static_cast<double>(offset)),
+          Napi::Number::New(env, static_cast<double>(length)) };
+      },
+      [buffer, length, &count](const Napi::CallbackInfo &info) {
+        if ((info.Length() > 1) && info[1].IsBuffer()) {
+          Napi::Buffer<uint8_t> chunk = info[1].As<Napi::Buffer<uint8_t>>();
+          count = std::min(length, chunk.Length());
+          memcpy(buffer, chunk.Data(), count);
+        }
+      });
+    m_Offset += count;
+    return count;
+  }
+
+  virtual void rewind() override { m_Offset = 0; }
+
+private:
+  const Napi::ThreadSafeFunction &m_TSFN;
+  const Napi::ObjectReference &m_Source;
+  uint64_t m_Size;
+  uint64_t m_Offset{ 0 };
+};
+
+/**
+ * writer sink that hands chunks to a js object with a
+ * write(chunk, callback(err)) method. Only one chunk is in flight at a time
+ */
+class JSChunkSink : public WriterSink {
+public:
+  JSChunkSink(const Napi::ThreadSafeFunction &tsfn, const Napi::ObjectReference &sink)
+    : m_TSFN(tsfn), m_Sink(sink)
+  {}
+
+  virtual void write(const uint8_t *data, size_t length) override {
+    BlockingJSCall::call(m_TSFN, m_Sink, "write",
+      [data, length](Napi::Env env) {
+        return std::vector<napi_value>{ Napi::Buffer<uint8_t>::Copy(env, data, length) };
+      },
+      [](const Napi::CallbackInfo&) {});
+  }
+
+  virtual bool seekable() const override { return false; }
+  virtual void seek(uint64_t) override { throw std::runtime_error("sink not seekable"); }
+
+private:
+  const Napi::ThreadSafeFunction &m_TSFN;
+  const Napi::ObjectReference &m_Sink;
+};
+
+/**
+ * archive source backed by a js function (offset, length) => Buffer. Reads happen
+ * on worker threads and get forwarded to the main thread, a whole batch of ranges
+ * costs a single crossing.
+ * The function must not be called from the main thread itself, it would block
+ * waiting for itself
+ */
+class JSArchiveSource : public ArchiveSource {
+public:
+  JSArchiveSource(Napi::Env env, const Napi::Function &read, uint64_t size)
+    : m_Size(size)
+  {
+    m_TSFN = Napi::ThreadSafeFunction::New(env, read, "ArchiveSourceRead", 0, 1);
+    // an open archive shouldn't keep the process alive
+    m_TSFN.Unref(env);
+  }
+
+  ~JSArchiveSource() {
+    m_TSFN.Release();
+  }
+
+  virtual uint64_t size() const override { return m_Size; }
+
+  virtual void read(uint64_t offset, uint8_t *buffer, size_t length) override {
+    SourceRead single{ offset, length, buffer };
+    readBatch(&single, 1);
+  }
+
+  virtual void readBatch(const SourceRead *reads, size_t count) override {
+    if (!m_Open) {
+      throw std::runtime_error("access failed");
+    }
+    for (size_t i = 0; i < count; ++i) {
+      if (reads[i].offset + reads[i].length > m_Size) {
+        throw std::runtime_error("invalid data");
+      }
+    }
+
+    Batch batch(reads, count);
+    if (m_TSFN.BlockingCall(&batch, &JSArchiveSource::invoke) != napi_ok) {
+      throw std::runtime_error("access failed");
+    }
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.signal.wait(lock, [&batch]() { return batch.done; });
+    if (!batch.error.empty()) {
+      throw std::runtime_error(batch.error);
+    }
+  }
+
+  virtual bool isOpen() const override { return m_Open; }
+
+  // the tsfn is only released on destruction, a read may still be in flight
+  virtual void close() override { m_Open = false; }
+
+private:
+  struct Batch {
+    Batch(const SourceRead *reads, size_t count) : reads(reads), count(count) {}
+
+    const SourceRead *reads;
+    size_t count;
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool done{ false };
+    std::string error;
+  };
+
+  static void invoke(Napi::Env env, Napi::Function read, Batch *batch) {
+    std::string error = "access failed";
+    if (env != nullptr) {
+      error.clear();
+      try {
+        for (size_t i = 0; i < batch->count; ++i) {
+          const SourceRead &range = batch->reads[i];
+          Napi::Value result = read.Call({
+            Napi::Number::New(env, static_cast<double>(range.offset)),
+            Napi::Number::New(env, static_cast<double>(range.length)) });
+          if (!result.IsBuffer() || (result.As<Napi::Buffer<uint8_t>>().Length() < range.length)) {
+            throw std::runtime_error("invalid data");
+          }
+          memcpy(range.buffer, result.As<Napi::Buffer<uint8_t>>().Data(), range.length);
+        }
+      }
+      catch (const std::exception &e) {
+        error = e.what();
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(batch->mutex);
+    batch->error = error;
+    batch->done = true;
+    batch->signal.notify_all();
+  }
+
+private:
+  Napi::ThreadSafeFunction m_TSFN;
+  uint64_t m_Size;
+  std::atomic<bool> m_Open{ true };
+};
+
+class WriteWorker : public ScheduledWorker {
+public:
+  /// target has to be a file descriptor or an object
+  WriteWorker(const Napi::Value &target, const Napi::Function &appCallback)
+    : ScheduledWorker(appCallback, WorkScheduler::Pool::CPU, this)
+  {
+    SetOperation(LatencyMetrics::Operation::WRITE);
+    m_TSFN = Napi::ThreadSafeFunction::New(appCallback.Env(), appCallback, "BSAWriteCB", 0, 1);
+    if (target.IsNumber()) {
+      int fd = target.ToNumber().Int32Value();
+#ifdef _WIN32
+      m_Sink = makeHandleSink(reinterpret_cast<void*>(uv_get_osfhandle(fd)));
+#else
+      m_Sink = makeHandleSink(fd);
+#endif
+    } else {
+      m_SinkRef = Napi::Persistent(target.ToObject());
+      m_Sink.reset(new JSChunkSink(m_TSFN, m_SinkRef));
+    }
+  }
+
+  /// source that reads through the worker's tsfn, valid for as long as the worker
+  std::unique_ptr<WriterSource> pullSource(const Napi::ObjectReference &source, uint64_t size) {
+    return std::unique_ptr<WriterSource>(new JSPullSource(m_TSFN, source, size));
+  }
+
+  /// hand over the writer and the references its sources use, the worker can be queued after this
+  void setWriter(std::unique_ptr<ArchiveWriter> writer, std::vector<Napi::ObjectReference> references) {
+    m_Writer = std::move(writer);
+    m_References = std::move(references);
+  }
+
+  /// destroy a worker that never got queued
+  void discard() {
+    m_TSFN.Release();
+    delete this;
+  }
+
+  virtual void Execute() override {
+    try {
+      m_Writer->write(*m_Sink);
+    }
+    catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  virtual void OnOK() override {
+    m_TSFN.Release();
+    Callback().Call(Receiver().Value(), std::initializer_list<napi_value>{ Env().Null() });
+  }
+
+  virtual void OnError(const Napi::Error &e) override {
+    m_TSFN.Release();
+    ScheduledWorker::OnError(e);
+  }
+
+private:
+  std::unique_ptr<ArchiveWriter> m_Writer;
+  std::unique_ptr<WriterSink> m_Sink;
+  // keeps buffers and js sources/sinks alive while writing
+  std::vector<Napi::ObjectReference> m_References;
+  Napi::ObjectReference m_SinkRef;
+  Napi::ThreadSafeFunction m_TSFN;
+};
+
+class BSAWriter : public Napi::ObjectWrap<BSAWriter>, public CountedObject<MemoryCategory::WRAPPERS> {
+public:
+  static Napi::FunctionReference Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "BSAWriter", {
+      InstanceMethod("addFile", &BSAWriter::addFile),
+      InstanceMethod("writeTo", &BSAWriter::writeTo),
+    });
+    exports.Set("BSAWriter", func);
+    return Napi::Persistent(func);
+  }
+
+  BSAWriter(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<BSAWriter>(info)
+  {
+    uint32_t version = ArchiveIndex::VERSION_SKYRIM;
+    if (info[0].IsString() && (info[0].ToString().Utf8Value() == "oblivion")) {
+      version = ArchiveIndex::VERSION_OBLIVION;
+    }
+    m_Writer.reset(new ArchiveWriter(version));
+  }
+
+  Napi::Value addFile(const Napi::CallbackInfo &info) {
+    if (!m_Writer) {
+      throw Napi::Error::New(info.Env(), "archive already written");
+    }
+    std::string filePath = info[0].ToString();
+    Napi::Value source = info[1];
+    bool compressed = info[2].ToBoolean();
+
+    try {
+      if (source.IsString()) {
+        m_Writer->addFile(filePath, makeFileSource(source.ToString()), compressed);
+      } else if (source.IsBuffer()) {
+        Napi::Buffer<uint8_t> buffer = source.As<Napi::Buffer<uint8_t>>();
+        m_Writer->addFile(filePath, makeMemorySource(buffer.Data(), buffer.Length()), compressed);
+        m_References.push_back(Napi::Persistent(source.ToObject()));
+      } else if (source.IsObject()) {
+        Napi::Object obj = source.ToObject();
+        uint64_t size = static_cast<uint64_t>(obj.Get("size").ToNumber().Int64Value());
+        // the source is only created in writeTo, invalid files have to be rejected now
+        ArchiveWriter::checkFile(filePath, size);
+        m_PullSources.push_back({ filePath, size, compressed, m_References.size() });
+        m_References.push_back(Napi::Persistent(obj));
+      } else {
+        throw Napi::TypeError::New(info.Env(), "invalid source");
+      }
+    }
+    catch (const std::runtime_error &e) {
+      throw Napi::Error::New(info.Env(), e.what());
+    }
+    return info.Env().Undefined();
+  }
+
+  Napi::Value writeTo(const Napi::CallbackInfo &info) {
+    if (!m_Writer) {
+      throw Napi::Error::New(info.Env(), "archive already written");
+    }
+
+    if (!info[0].IsNumber() && !info[0].IsObject()) {
+      throw Napi::TypeError::New(info.Env(), "invalid target");
+    }
+    WorkScheduler::Priority priority = priorityOption(info.Env(), info[2]);
+
+    auto worker = new WriteWorker(info[0], info[1].As<Napi::Function>());
+    // sources pulled from js need the worker's tsfn so they are added last. Their
+    // files were checked in addFile so this can only run out of memory
+    try {
+      for (const PullSource &source : m_PullSources) {
+        m_Writer->addFile(source.filePath, worker->pullSource(m_References[source.reference], source.size),
+                          source.compressed);
+      }
+    }
+    catch (const std::exception &e) {
+      // sources added so far refer to the worker, the writer can't be used any more
+      worker->discard();
+      m_Writer.reset();
+      m_References.clear();
+      m_PullSources.clear();
+      throw Napi::Error::New(info.Env(), e.what());
+    }
+    m_PullSources.clear();
+    // moving the references keeps them in place, the pull sources point at them
+    worker->setWriter(std::move(m_Writer), std::move(m_References));
+    worker->SetPriority(priority);
+    worker->Queue();
+    return info.Env().Undefined();
+  }
+
+private:
+  struct PullSource {
+    std::string filePath;
+    uint64_t size;
+    bool compressed;
+    size_t reference;
+  };
+
+  std::unique_ptr<ArchiveWriter> m_Writer;
+  std::vector<Napi::ObjectReference> m_References;
+  std::vector<PullSource> m_PullSources;
 };
 
-BSAddon::BSAddon(Napi::Env env, Napi::Object exports) {
+BSAddon::BSAddon(Napi::Env env, Napi::Object exports)
+  : m_Env(env)
+{
+  ++s_Instances;
   DefineAddon(exports, {
     InstanceMethod("loadBSA", &BSAddon::loadBSA),
+    InstanceMethod("loadBSAFromBuffer", &BSAddon::loadBSAFromBuffer),
+    InstanceMethod("loadBSAFromReader", &BSAddon::loadBSAFromReader),
     InstanceMethod("createBSA", &BSAddon::createBSA),
+    InstanceMethod("createWriter", &BSAddon::createWriter),
+    InstanceMethod("attachBSA", &BSAddon::attachBSA),
+    InstanceMethod("releaseIndex", &BSAddon::releaseIndex),
+    InstanceMethod("attachSharedBSA", &BSAddon::attachSharedBSA),
+    InstanceMethod("unpublishIndex", &BSAddon::unpublishIndex),
+    InstanceMethod("scanTextureHeaders", &BSAddon::scanTextureHeaders),
+    InstanceMethod("extractArchives", &BSAddon::extractArchives),
+    InstanceMethod("setMemoryBudget", &BSAddon::setMemoryBudget),
+    InstanceMethod("setMaxOpenArchives", &BSAddon::setMaxOpenArchives),
+    InstanceMethod("configureScheduler", &BSAddon::configureScheduler),
+    InstanceMethod("getMetrics", &BSAddon::getMetrics),
+    InstanceMethod("getMemoryUsage", &BSAddon::getMemoryUsage),
     });
   constructArchive = BSArchive::Init(env, exports);
   constructFolder = BSAFolder::Init(env, exports);
   constructFile = BSAFile::Init(env, exports);
+  constructWriter = BSAWriter::Init(env, exports);
+
+  m_Scheduler.reset(new WorkScheduler(std::max(std::thread::hardware_concurrency(), 1U), DEFAULT_IO_WORKERS));
+  m_Completions = Napi::ThreadSafeFunction::New(env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}),
+                                                "BSACompletion", 0, 1);
+  m_Completions.Unref(env);
+  // cleanup hooks run in reverse order so the threads are stopped before the
+  // completion tsfn they report to gets torn down
+  napi_add_env_cleanup_hook(env, &BSAddon::stopScheduler, m_Scheduler.get());
+}
+
+BSAddon::~BSAddon() {
+  --s_Instances;
+  napi_remove_env_cleanup_hook(m_Env, &BSAddon::stopScheduler, m_Scheduler.get());
+  m_Scheduler->shutdown();
+}
+
+void BSAddon::stopScheduler(void *scheduler) {
+  static_cast<WorkScheduler*>(scheduler)->shutdown();
+}
+
+void BSAddon::beginWork(Napi::Env env) {
+  if (m_PendingWork++ == 0) {
+    m_Completions.Ref(env);
+  }
+}
+
+void BSAddon::finishWork(ScheduledWorker *worker) {
+  // if the environment is shutting down the worker is leaked, its callback can't
+  // be called anymore anyway
+  m_Completions.BlockingCall(worker, [this](Napi::Env env, Napi::Function, ScheduledWorker *worker) {
+    if (--m_PendingWork == 0) {
+      m_Completions.Unref(env);
+    }
+    worker->complete();
+  });
+}
+
+void BSAddon::syncExternalMemory(Napi::Env env) {
+  int64_t current = static_cast<int64_t>(MemoryAccount::process().total())
+                  / std::max<int64_t>(s_Instances.load(), 1);
+  if (current != m_ReportedMemory) {
+    Napi::MemoryManagement::AdjustExternalMemory(env, current - m_ReportedMemory);
+    m_ReportedMemory = current;
+  }
 }
 
 Napi::Value BSAddon::loadBSA(const Napi::CallbackInfo& info) {
@@ -401,6 +2031,53 @@ Napi::Value BSAddon::loadBSA(const Napi::CallbackInfo& info) {
   return info.Env().Undefined();
 }
 
+Napi::Value BSAddon::loadBSAFromBuffer(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  Napi::HandleScope scope(env);
+
+  if (!info[0].IsBuffer()) {
+    throw Napi::TypeError::New(env, "expected a Buffer");
+  }
+  Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+  Napi::Boolean testHashes = info[1].ToBoolean();
+  Napi::Function cb = info[2].As<Napi::Function>();
+
+  Napi::Object result = constructArchive.New({ Napi::String::New(env, "") });
+  BSArchive* resultObj = BSArchive::Unwrap(result);
+
+  resultObj->readBufferAsync(info, buffer, testHashes, cb);
+
+  return info.Env().Undefined();
+}
+
+Napi::Value BSAddon::loadBSAFromReader(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  Napi::HandleScope scope(env);
+
+  Napi::Object reader = info[0].ToObject();
+  if (!reader.Get("read").IsFunction()) {
+    throw Napi::TypeError::New(env, "reader requires a read function");
+  }
+  double size = reader.Get("size").ToNumber().DoubleValue();
+  if (!(size >= 0)) {
+    throw Napi::TypeError::New(env, "reader requires a size");
+  }
+  // bound so read gets called as a method of the reader
+  Napi::Function read = reader.Get("read").As<Napi::Function>();
+  Napi::Function bound = read.Get("bind").As<Napi::Function>().Call(read, { reader }).As<Napi::Function>();
+
+  Napi::Boolean testHashes = info[1].ToBoolean();
+  Napi::Function cb = info[2].As<Napi::Function>();
+
+  Napi::Object result = constructArchive.New({ Napi::String::New(env, "") });
+  BSArchive* resultObj = BSArchive::Unwrap(result);
+
+  std::unique_ptr<ArchiveSource> source(new JSArchiveSource(env, bound, static_cast<uint64_t>(size)));
+  resultObj->readSourceAsync(info, std::move(source), testHashes, cb);
+
+  return info.Env().Undefined();
+}
+
 Napi::Value BSAddon::createBSA(const Napi::CallbackInfo& info) {
   Napi::Function cb = info[1].As<Napi::Function>();
   Napi::Object result = BSArchive::CreateNewItem(info);
@@ -409,4 +2086,252 @@ Napi::Value BSAddon::createBSA(const Napi::CallbackInfo& info) {
   return info.Env().Undefined();
 }
 
+Napi::Value BSAddon::createWriter(const Napi::CallbackInfo& info) {
+  Napi::Value type = info.Env().Undefined();
+  if (info[0].IsObject() && info[0].ToObject().Has("type")) {
+    type = info[0].ToObject().Get("type");
+  }
+  return constructWriter.New({ type });
+}
+
+Napi::Value BSAddon::attachBSA(const Napi::CallbackInfo& info) {
+  uint32_t handle = info[0].ToNumber().Uint32Value();
+
+  try {
+    return attachEntry(info.Env(), IndexRegistry::lookup(handle));
+  }
+  catch (const std::exception& e) {
+    throw Napi::Error::New(info.Env(), e.what());
+  }
+}
+
+Napi::Value BSAddon::attachSharedBSA(const Napi::CallbackInfo& info) {
+  std::string name = info[0].ToString();
+
+  try {
+    return attachEntry(info.Env(), IndexRegistry::attachShared(name));
+  }
+  catch (const std::exception& e) {
+    throw Napi::Error::New(info.Env(), e.what());
+  }
+}
+
+Napi::Value BSAddon::unpublishIndex(const Napi::CallbackInfo& info) {
+  IndexRegistry::unpublishShared(info[0].ToString());
+  return info.Env().Undefined();
+}
+
+Napi::Value BSAddon::scanTextureHeaders(const Napi::CallbackInfo& info) {
+  Napi::Array list = info[0].As<Napi::Array>();
+  Napi::Function cb = info[1].As<Napi::Function>();
+  WorkScheduler::Priority priority = priorityOption(info.Env(), info[2]);
+
+  std::vector<std::shared_ptr<ArchiveReader>> archives;
+  for (uint32_t i = 0; i < list.Length(); ++i) {
+    const std::shared_ptr<ArchiveReader> &reader = BSArchive::Unwrap(list.Get(i).ToObject())->reader();
+    if (!reader) {
+      throw Napi::Error::New(info.Env(), "archive not loaded");
+    }
+    archives.push_back(reader);
+  }
+
+  // archives are scanned in parallel, each by a single worker
+  std::vector<std::shared_ptr<ArchiveReader>> distinct(archives);
+  std::sort(distinct.begin(), distinct.end());
+  size_t numDistinct = std::unique(distinct.begin(), distinct.end()) - distinct.begin();
+  unsigned parallelism = static_cast<unsigned>(
+    std::min<size_t>(numDistinct, m_Scheduler->workers(WorkScheduler::Pool::IO)));
+
+  ScanTexturesWorker *worker = new ScanTexturesWorker(std::move(archives), parallelism, cb);
+  worker->SetPriority(priority);
+  worker->Queue();
+  return info.Env().Undefined();
+}
+
+Napi::Value BSAddon::extractArchives(const Napi::CallbackInfo& info) {
+  Napi::Array list = info[0].As<Napi::Array>();
+  Napi::Function cb = info[1].As<Napi::Function>();
+  IOSchedule schedule = scheduleOption(info.Env(), info[2]);
+  WorkScheduler::Priority priority = priorityOption(info.Env(), info[2]);
+  Napi::Value onProgress = info[2].IsObject() ? info[2].ToObject().Get("onProgress") : info.Env().Undefined();
+
+  std::vector<DeployJob> jobs;
+  for (uint32_t i = 0; i < list.Length(); ++i) {
+    Napi::Object item = list.Get(i).ToObject();
+    DeployJob job;
+    job.reader = BSArchive::Unwrap(item.Get("archive").ToObject())->reader();
+    if (!job.reader) {
+      throw Napi::Error::New(info.Env(), "archive not loaded");
+    }
+    job.outputDirectory = item.Get("outputDir").ToString();
+    Napi::Value filter = item.Get("filter");
+    if (filter.IsObject()) {
+      job.filter = filter.ToObject().Get("query").ToString();
+      if (filter.ToObject().Has("mode")) {
+        job.filterMode = searchModeOption(info.Env(), filter.ToObject().Get("mode"));
+      }
+    } else if (!filter.IsUndefined() && !filter.IsNull()) {
+      throw Napi::TypeError::New(info.Env(), "invalid filter");
+    }
+    jobs.push_back(std::move(job));
+  }
+
+  std::shared_ptr<Deployment> deployment = std::make_shared<Deployment>(std::move(jobs), schedule);
+  DeployWorker *worker = new DeployWorker(deployment, m_Scheduler->workers(WorkScheduler::Pool::IO),
+                                          onProgress, cb);
+  worker->SetPriority(priority);
+  worker->Queue();
+
+  // the handle doesn't keep the archives alive once the deployment is done
+  std::weak_ptr<Deployment> weak(deployment);
+  Napi::Object handle = Napi::Object::New(info.Env());
+  handle.Set("cancel", Napi::Function::New(info.Env(), [weak](const Napi::CallbackInfo &info) {
+    std::shared_ptr<Deployment> deployment = weak.lock();
+    if (deployment) {
+      deployment->cancel();
+    }
+    return info.Env().Undefined();
+  }, "cancel"));
+  return handle;
+}
+
+Napi::Value BSAddon::setMemoryBudget(const Napi::CallbackInfo& info) {
+  double limit = info[0].ToNumber().DoubleValue();
+  if (!(limit >= 1)) {
+    throw Napi::RangeError::New(info.Env(), "invalid memory budget");
+  }
+  MemoryBudget::extraction().setLimit(static_cast<uint64_t>(limit));
+  return info.Env().Undefined();
+}
+
+Napi::Value BSAddon::setMaxOpenArchives(const Napi::CallbackInfo& info) {
+  double limit = info[0].ToNumber().DoubleValue();
+  if (!(limit >= 1)) {
+    throw Napi::RangeError::New(info.Env(), "invalid handle limit");
+  }
+  HandlePool::archives().setLimit(static_cast<size_t>(std::min<double>(limit, SIZE_MAX)));
+  return info.Env().Undefined();
+}
+
+Napi::Value BSAddon::configureScheduler(const Napi::CallbackInfo& info) {
+  if (info[0].IsObject()) {
+    Napi::Object options = info[0].ToObject();
+    const std::pair<const char*, WorkScheduler::Pool> pools[] = {
+      { "cpuWorkers", WorkScheduler::Pool::CPU },
+      { "ioWorkers", WorkScheduler::Pool::IO },
+    };
+    for (const auto &pool : pools) {
+      if (options.Has(pool.first)) {
+        double count = options.Get(pool.first).ToNumber().DoubleValue();
+        if (!(count >= 1) || (count > MAX_WORKERS)) {
+          throw Napi::RangeError::New(info.Env(), "invalid worker count");
+        }
+        m_Scheduler->setWorkers(pool.second, static_cast<unsigned>(count));
+      }
+    }
+  }
+
+  Napi::Object result = Napi::Object::New(info.Env());
+  result.Set("cpuWorkers", m_Scheduler->workers(WorkScheduler::Pool::CPU));
+  result.Set("ioWorkers", m_Scheduler->workers(WorkScheduler::Pool::IO));
+  return result;
+}
+
+Napi::Value BSAddon::getMetrics(const Napi::CallbackInfo& info) {
+  const std::pair<const char*, LatencyMetrics::Operation> operations[] = {
+    { "loadBSA", LatencyMetrics::Operation::LOAD },
+    { "navigate", LatencyMetrics::Operation::NAVIGATE },
+    { "extractFile", LatencyMetrics::Operation::EXTRACT_FILE },
+    { "extractAll", LatencyMetrics::Operation::EXTRACT_ALL },
+    { "write", LatencyMetrics::Operation::WRITE },
+  };
+  const std::pair<const char*, double> percentiles[] = {
+    { "p50", 0.5 }, { "p90", 0.9 }, { "p99", 0.99 }, { "p999", 0.999 },
+  };
+  // reported in milliseconds
+  auto toMS = [](double nanoseconds) { return nanoseconds / 1000000.0; };
+
+  LatencyMetrics &metrics = LatencyMetrics::operations();
+  Napi::Object result = Napi::Object::New(info.Env());
+  for (const auto &operation : operations) {
+    LatencyMetrics::Histogram histogram = metrics.histogram(operation.second);
+    Napi::Object item = Napi::Object::New(info.Env());
+    item.Set("count", static_cast<double>(histogram.count()));
+    item.Set("mean", toMS(histogram.mean()));
+    for (const auto &percentile : percentiles) {
+      item.Set(percentile.first, toMS(static_cast<double>(histogram.percentile(percentile.second))));
+    }
+    item.Set("max", toMS(static_cast<double>(histogram.max())));
+    result.Set(operation.first, item);
+  }
+
+  if (info[0].IsObject() && info[0].ToObject().Get("reset").ToBoolean()) {
+    metrics.reset();
+  }
+  return result;
+}
+
+Napi::Value BSAddon::getMemoryUsage(const Napi::CallbackInfo& info) {
+  const std::pair<const char*, MemoryCategory> categories[] = {
+    { "index", MemoryCategory::INDEX },
+    { "names", MemoryCategory::NAMES },
+    { "caches", MemoryCategory::CACHES },
+    { "buffers", MemoryCategory::BUFFERS },
+    { "wrappers", MemoryCategory::WRAPPERS },
+    { "workers", MemoryCategory::WORKERS },
+  };
+  struct Usage {
+    std::string name;
+    uint64_t total;
+    uint64_t used[MemoryAccount::NUM_CATEGORIES];
+  };
+  auto snapshot = [&categories](const MemoryAccount &account) {
+    Usage result{ account.name(), account.total(), {} };
+    for (size_t i = 0; i < MemoryAccount::NUM_CATEGORIES; ++i) {
+      result.used[i] = account.used(categories[i].second);
+    }
+    return result;
+  };
+
+  // js objects are created after the accounts are unlocked, a gc running
+  // finalizers may destroy indexes meanwhile
+  MemoryAccount &process = MemoryAccount::process();
+  Usage total = snapshot(process);
+  std::vector<Usage> accounts;
+  process.visitAccounts([&](const MemoryAccount &account) { accounts.push_back(snapshot(account)); });
+
+  Napi::Env env = info.Env();
+  auto toObject = [&](const Usage &usage) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("total", static_cast<double>(usage.total));
+    for (size_t i = 0; i < MemoryAccount::NUM_CATEGORIES; ++i) {
+      result.Set(categories[i].first, static_cast<double>(usage.used[i]));
+    }
+    return result;
+  };
+
+  Napi::Object result = toObject(total);
+  Napi::Array archives = Napi::Array::New(env, accounts.size());
+  for (uint32_t i = 0; i < accounts.size(); ++i) {
+    Napi::Object item = toObject(accounts[i]);
+    item.Set("name", accounts[i].name);
+    archives.Set(i, item);
+  }
+  result.Set("archives", archives);
+
+  syncExternalMemory(env);
+  return result;
+}
+
+Napi::Object BSAddon::attachEntry(Napi::Env env, const IndexRegistry::Entry &entry) {
+  Napi::Object result = constructArchive.New({ Napi::String::New(env, entry.fileName) });
+  BSArchive::Unwrap(result)->attach(entry.index, entry.fileName);
+  return result;
+}
+
+Napi::Value BSAddon::releaseIndex(const Napi::CallbackInfo& info) {
+  IndexRegistry::release(info[0].ToNumber().Uint32Value());
+  return info.Env().Undefined();
+}
+
 NODE_API_ADDON(BSAddon)
@@ -3,11 +3,139 @@ declare module 'bsatk' {
     constructor(fileName: string, testHashes: boolean, create: boolean);
     type: number;
     root: BSAFolder;
-    extractFile: (file: BSAFile, outputDirectory: string, callback: (err: Error) => void) => void;
-    extractAll: (outputDirectory: string, callback: (err: Error) => void) => void;
+    extractFile: (file: BSAFile, outputDirectory: string, callback: (err: Error) => void, options?: IWorkOptions) => void;
+    /**
+     * extract all files. By default the archive is read front to back if it's on a
+     * spinning disk, otherwise files get extracted in order of their path.
+     * The callback receives the manifest if it was requested as arrays
+     */
+    extractAll: ((outputDirectory: string, callback: (err: Error, manifest?: IManifest) => void, options?: IExtractOptions) => void)
+      /**
+       * decode all files and pass them to onFile instead of writing them to disk.
+       * Files are decoded in parallel and delivered in batches, in no particular
+       * order. Decoding pauses while onFile falls behind. If onFile throws the
+       * extraction stops and the callback receives the error
+       */
+      & ((sink: IFileSink, callback: (err: Error, manifest?: IManifest) => void, options?: IExtractOptions) => void);
+    /**
+     * read part of a file without extracting it, compressed files are only inflated
+     * as far as necessary. The result is shorter than length if the file ends early
+     */
+    readRange: (file: BSAFile, offset: number, length: number, callback: (err: Error, data: Buffer) => void, options?: IWorkOptions) => void;
+    /**
+     * read parts of many files as a single batch, e.g. the headers of all textures
+     */
+    readRanges: (ranges: IRange[], callback: (err: Error, data: Buffer[]) => void, options?: IWorkOptions) => void;
     write: () => void;
     createFile: (fileName: string, sourcePath: string, compressed: boolean) => BSAFile;
     closeArchive: () => void;
+    /**
+     * find files by path, case-insensitive. Results are paged, pass the "next" value
+     * of a result as the cursor to get the following page. "total" is only
+     * reported for prefix and suffix searches.
+     * The first search of an archive sorts all its paths, it runs in the background
+     * like every search. Searches of one archive call back in the order they were made
+     */
+    findFiles: (query: string, callback: (err: Error, result: IFindResult) => void, options?: IFindOptions) => void;
+    /**
+     * make the parsed index available to other worker threads. The returned handle
+     * can be passed to attachBSA on any thread and keeps the index alive until
+     * releaseIndex is called
+     */
+    exportIndex: () => number;
+    /**
+     * copy the parsed index into a named shared memory segment so other processes
+     * can open the archive with attachSharedBSA without parsing it again
+     */
+    publishIndex: (name: string) => void;
+  }
+
+  /**
+   * interactive work is served before everything else, background work only runs
+   * when nothing else is queued and never occupies all workers. Defaults to normal
+   */
+  export interface IWorkOptions {
+    priority?: 'interactive' | 'normal' | 'background';
+  }
+
+  export interface IExtractOptions extends IWorkOptions {
+    schedule?: 'auto' | 'offset' | 'path';
+    manifest?: IManifestOptions;
+  }
+
+  /**
+   * list of the extracted files, collected while they are written. ndjson writes one
+   * { path, size, crc32? } object per line to path, binary writes a compact file
+   * (see bsamanifest.h), arrays passes an IManifest to the callback.
+   * crc32 is computed from the data as it's written, the files aren't read again
+   */
+  export interface IManifestOptions {
+    format: 'ndjson' | 'binary' | 'arrays';
+    path?: string;
+    crc32?: boolean;
+  }
+
+  /// entries are in archive order, paths relative to the output directory
+  export interface IManifest {
+    paths: string[];
+    sizes: Float64Array;
+    crc32?: Uint32Array;
+  }
+
+  export interface IFileSink {
+    onFile: (filePath: string, data: Buffer) => void;
+  }
+
+  export interface IRange {
+    file: BSAFile;
+    offset: number;
+    length: number;
+  }
+
+  export interface IFindOptions extends IWorkOptions {
+    mode?: 'prefix' | 'suffix' | 'contains';
+    /// "next" of the previous page, only valid with the same query and mode
+    cursor?: number;
+    limit?: number;
+  }
+
+  export interface IFindResult {
+    files: BSAFile[];
+    /**
+     * cursor of the following page, null after the last one. Treat it as opaque,
+     * its meaning depends on the mode: for prefix and suffix searches it's the
+     * number of matches returned so far, for contains searches the id of the file
+     * to resume the scan at
+     */
+    next: number | null;
+    total?: number;
+  }
+
+  /**
+   * source that gets pulled from as the archive is written. The data may be
+   * requested twice when writing compressed files to a target that can't seek
+   */
+  export interface IPullSource {
+    size: number;
+    read: (offset: number, length: number, callback: (err: Error, data?: Buffer) => void) => void;
+  }
+
+  /**
+   * target that receives the archive in chunks, callback has to be called
+   * before the next chunk is sent. A stream.Writable can be adapted with
+   * (chunk, cb) => writable.write(chunk) ? cb() : writable.once('drain', () => cb())
+   */
+  export interface IChunkSink {
+    write: (chunk: Buffer, callback: (err?: Error) => void) => void;
+  }
+
+  export class BSAWriter {
+    addFile: (filePath: string, source: string | Buffer | IPullSource, compressed: boolean) => void;
+    /**
+     * write the archive to a file descriptor or chunk sink. A writer can only be
+     * written once
+     */
+    writeTo: (target: number | IChunkSink, callback: (err: Error) => void, options?: IWorkOptions) => void;
   }
 
   export class BSAFile {
@@ -28,6 +156,174 @@ declare module 'bsatk' {
     addFolder(name: string): BSAFolder;
   }
 
-  export function loadBSA(fileName: string, testHashes: boolean, callback: (err: Error, archive: BSArchive) => void);
+  export function loadBSA(fileName: string, testHashes: boolean, callback: (err: Error, archive: BSArchive) => void, options?: IWorkOptions);
+  /**
+   * random access to an archive stored elsewhere, for example uncompressed inside a
+   * zip or as a slice of a larger file. read is called on the main thread and has to
+   * return exactly the requested range
+   */
+  export interface IArchiveReader {
+    size: number;
+    read: (offset: number, length: number) => Buffer;
+  }
+
+  /**
+   * open an archive held in memory, for example one read from inside another
+   * container. The buffer is used without copying and must not be modified while
+   * the archive is in use
+   */
+  export function loadBSAFromBuffer(buffer: Buffer, testHashes: boolean, callback: (err: Error, archive: BSArchive) => void, options?: IWorkOptions);
+  /**
+   * open an archive through a reader. Reads are batched, a single extractAll call
+   * requests many ranges at once
+   */
+  export function loadBSAFromReader(reader: IArchiveReader, testHashes: boolean, callback: (err: Error, archive: BSArchive) => void, options?: IWorkOptions);
   export function createBSA(fileName: string, callback: (err: Error, archive: BSArchive) => void);
+  export function createWriter(options?: { type?: 'oblivion' | 'skyrim' }): BSAWriter;
+  /**
+   * limit the memory used for buffers by all extractions in the process, 256MB by
+   * default. Extractions wait for memory to become available, large files are
+   * streamed in chunks. Applies to loaded archives
+   */
+  export function setMemoryBudget(bytes: number): void;
+  /**
+   * limit the number of archive files held open, 256 by default. The least recently
+   * used archives get their file closed while idle and reopened on the next read,
+   * which fails if the file was replaced or modified in the meantime
+   */
+  export function setMaxOpenArchives(count: number): void;
+  export interface ISchedulerConfig {
+    cpuWorkers: number;
+    ioWorkers: number;
+  }
+  /**
+   * change the number of threads used for asynchronous work. Loading and writing
+   * archives runs on the cpu workers (one per core by default), extraction, range
+   * reads and texture scans on the io workers (4 by default). Archives take turns
+   * so a large extraction doesn't hold up work on other archives.
+   * Returns the configuration now in effect, call without options to query it
+   */
+  export function configureScheduler(options?: Partial<ISchedulerConfig>): ISchedulerConfig;
+  /**
+   * latency of one kind of operation in milliseconds. Percentiles are accurate to
+   * about 6%
+   */
+  export interface ILatency {
+    count: number;
+    mean: number;
+    p50: number;
+    p90: number;
+    p99: number;
+    p999: number;
+    max: number;
+  }
+  export interface IMetrics {
+    loadBSA: ILatency;
+    /// getRoot, getSubFolder and getFile
+    navigate: ILatency;
+    extractFile: ILatency;
+    extractAll: ILatency;
+    /// write and writeTo
+    write: ILatency;
+  }
+  /**
+   * latencies of all operations since the start of the process or the last reset.
+   * Asynchronous operations are measured from the call to the callback, including
+   * the time they were queued
+   */
+  export function getMetrics(options?: { reset?: boolean }): IMetrics;
+  /// native memory in bytes by subsystem
+  export interface IMemoryUsage {
+    total: number;
+    /// arrays of parsed indexes
+    index: number;
+    /// name pools of parsed indexes
+    names: number;
+    /// lookup structures built by findFiles
+    caches: number;
+    /// buffers of extractions in flight
+    buffers: number;
+    /// native part of archive, folder, file and writer objects
+    wrappers: number;
+    /// asynchronous calls that haven't called back yet
+    workers: number;
+  }
+  export interface IArchiveMemoryUsage extends IMemoryUsage {
+    /// file name of the archive, empty for archives loaded from memory
+    name: string;
+  }
+  /**
+   * native memory held by the addon, in total and for each loaded archive index.
+   * Archives attached to the same index share it, only one of them is listed.
+   * The total is also reported to v8 as external memory, split evenly between the
+   * worker threads that loaded the addon
+   */
+  export function getMemoryUsage(): IMemoryUsage & { archives: IArchiveMemoryUsage[] };
+  /**
+   * headers of all textures found by scanTextureHeaders. headers holds 6 values per
+   * texture: index of the archive in the list, width, height, mip count, fourCC
+   * (0 for uncompressed formats) and dxgi format (only set if fourCC is "DX10").
+   * Textures without a valid header or whose data can't be decoded, like lz4
+   * compressed ones in skyrim se archives, have all values but the archive set to 0
+   */
+  export interface ITextureScan {
+    paths: string[];
+    headers: Uint32Array;
+  }
+
+  /**
+   * read the headers of every .dds file in the archives without extracting them.
+   * The archives are scanned in parallel
+   */
+  export function scanTextureHeaders(archives: BSArchive[], callback: (err: Error, result: ITextureScan) => void, options?: IWorkOptions);
+  export interface IDeployJob {
+    archive: BSArchive;
+    outputDir: string;
+    /// only extract files matching the query, as with findFiles
+    filter?: { query: string, mode?: 'prefix' | 'suffix' | 'contains' };
+  }
+
+  /// sizes are those of the records in the archives
+  export interface IDeployProgress {
+    files: number;
+    totalFiles: number;
+    size: number;
+    totalSize: number;
+  }
+
+  export interface IDeployOptions extends IWorkOptions {
+    schedule?: 'auto' | 'offset' | 'path';
+    /**
+     * called about every 100ms once all archives have been planned. If it throws
+     * the deployment is canceled and the callback receives the error
+     */
+    onProgress?: (progress: IDeployProgress) => void;
+  }
+
+  export interface IDeployResult {
+    files: number;
+    size: number;
+    /// null if all files of the archive were extracted
+    error: Error | null;
+  }
+
+  /**
+   * extract many archives as one job. All io workers take part and move between
+   * archives as they run out of work, archives with more data left get more of
+   * them so large and small archives overlap. A failing archive doesn't stop the
+   * others, results are reported per archive in the order of the list. After
+   * cancel, archives that didn't finish report a "canceled" error
+   */
+  export function extractArchives(jobs: IDeployJob[], callback: (err: Error, results: IDeployResult[]) => void,
+                                  options?: IDeployOptions): { cancel: () => void };
+  /**
+   * open an archive read-only using an index exported from another thread
+   */
+  export function attachBSA(handle: number): BSArchive;
+  export function releaseIndex(handle: number): void;
+  /**
+   * open an archive read-only using an index published by another process
+   */
+  export function attachSharedBSA(name: string): BSArchive;
+  export function unpublishIndex(name: string): void;
 }